@@ -0,0 +1,82 @@
+#include "blep.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#define CUTOFF 0.45 // Of the sample rate, a little below Nyquist
+#define RESOLUTION (BLEP_PHASES * 4) // Points per sample the step is integrated at
+#define BASS_SHIFT 9 // Removes DC like the Gameboy's output capacitor
+
+static s32 kernel[BLEP_PHASES][BLEP_WIDTH];
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/*
+    Integrates a Blackman windowed sinc into a step rising from 0 to 1 over
+    BLEP_WIDTH samples. kernel[p] holds the differences between successive
+    samples of that step when it's centered p/BLEP_PHASES samples late
+*/
+static void build_kernel() {
+    static double step[BLEP_WIDTH * RESOLUTION + 1];
+    double x, h, sum = 0.0;
+    int i, p, k, m, center;
+    s32 total;
+
+    for(i = 0; i <= BLEP_WIDTH * RESOLUTION; i++) {
+        x = (double)i / RESOLUTION - BLEP_WIDTH / 2;
+        h = x == 0.0 ? 2.0 * CUTOFF : sin(2.0 * M_PI * CUTOFF * x) / (M_PI * x);
+        h *= 0.42 + 0.5 * cos(2.0 * M_PI * x / BLEP_WIDTH) + 0.08 * cos(4.0 * M_PI * x / BLEP_WIDTH);
+        sum += h / RESOLUTION;
+        step[i] = sum;
+    }
+
+    for(p = 0; p < BLEP_PHASES; p++) {
+        total = 0;
+        for(k = 0; k < BLEP_WIDTH; k++) {
+            m = k * RESOLUTION - p * (RESOLUTION / BLEP_PHASES);
+            kernel[p][k] = lround((step[m + RESOLUTION] - (m < 0 ? 0.0 : step[m])) / sum * (1 << BLEP_SHIFT));
+            total += kernel[p][k];
+        }
+
+        // The steps must add up to exactly one, or the integrated level drifts
+        center = BLEP_WIDTH / 2 - 1 + (p >= BLEP_PHASES / 2);
+        kernel[p][center] += (1 << BLEP_SHIFT) - total;
+    }
+}
+
+void blep_clear(blep_t *blep) {
+    pthread_once(&kernel_once, build_kernel);
+
+    memset(blep, 0x00, sizeof(*blep));
+}
+
+void blep_add(blep_t *blep, u32 pos, s32 delta) {
+    const s32 *k = kernel[(pos >> (16 - 5)) & (BLEP_PHASES - 1)];
+    s32 *d;
+    int i;
+
+    if((pos >> 16) >= BLEP_SIZE) {
+        return;
+    }
+
+    d = &blep->deltas[pos >> 16];
+    for(i = 0; i < BLEP_WIDTH; i++) {
+        d[i] += delta * k[i];
+    }
+}
+
+void blep_read(blep_t *blep, s16 *out, int stride, int num) {
+    s32 sum = blep->sum;
+    s32 s;
+    int i;
+
+    for(i = 0; i < num; i++) {
+        sum += blep->deltas[i];
+        s = sum >> BLEP_SHIFT;
+        out[i * stride] = s > 32767 ? 32767 : s < -32768 ? -32768 : s;
+        sum -= sum >> BASS_SHIFT;
+    }
+    blep->sum = sum;
+
+    memmove(blep->deltas, &blep->deltas[num], (BLEP_SIZE + BLEP_WIDTH - num) * sizeof(*blep->deltas));
+    memset(&blep->deltas[BLEP_SIZE + BLEP_WIDTH - num], 0x00, num * sizeof(*blep->deltas));
+}
@@ -0,0 +1,33 @@
+#ifndef CORE_BLEP_H
+#define CORE_BLEP_H
+
+#include "defines.h"
+
+/*
+    Band-limited step buffer. Instead of sampling a channel's level, each
+    change of the level is added as a step, smeared over BLEP_WIDTH samples
+    by a windowed sinc kernel, at its exact position between two samples.
+    Reading integrates the steps back into samples, which contain nothing
+    above the Nyquist frequency and thus don't alias
+*/
+
+#define BLEP_PHASES 32 // Positions a step can take between two samples
+#define BLEP_WIDTH 16 // Samples a step is smeared over
+#define BLEP_SHIFT 15 // Fixed point bits of the kernel
+#define BLEP_SIZE 1024 // Samples buffered at most
+
+// Sample positions are 16.16 fixed point
+#define BLEP_POS(samples) ((u32)(samples) << 16)
+
+typedef struct {
+    s32 deltas[BLEP_SIZE + BLEP_WIDTH];
+    s32 sum;
+} blep_t;
+
+void blep_clear(blep_t *blep);
+void blep_add(blep_t *blep, u32 pos, s32 delta);
+
+// Integrates num samples into out, every stride'th s16, and removes them
+void blep_read(blep_t *blep, s16 *out, int stride, int num);
+
+#endif
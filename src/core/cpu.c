@@ -14,14 +14,14 @@
 #include "timers.h"
 #include "sys/sys.h"
 
+#include "instance.h"
 #ifdef DEBUG
 #include "debug/record.h"
 #endif
 
-cpu_t cpu;
 
 void cpu_reset() {
-    if(moo.hw == CGB_HW) {
+    if(MOO.hw == CGB_HW) {
         AF = 0x11B0;
     }
     else {
@@ -34,22 +34,27 @@ void cpu_reset() {
     SP = 0xFFFE;
     PC = 0x0100;
 
-    cpu.ime = IME_ON;
-    cpu.irq = 0x00;
-    cpu.ie = 0x00;
+    CPU.ime = IME_ON;
+    CPU.irq = 0x00;
+    CPU.ie = 0x00;
 
-    cpu.remainder = 0;
-    cpu.freq = NORMAL_CPU_FREQ;
-    cpu.freq_factor = 1;
-    cpu.halted = 0;
-    cpu.freq_switch = 0x00;
+    CPU.remainder = 0;
+    CPU.freq = NORMAL_CPU_FREQ;
+    CPU.freq_factor = 1;
+    CPU.halted = 0;
+    CPU.freq_switch = 0x00;
+
+#ifdef LAZY_FLAGS
+    CPU.lazy_op = LAZY_NONE;
+#endif
 
 #ifdef DEBUG
-    cpu.dbg_mcs = 0;
+    CPU.dbg_mcs = 0;
 #endif
 }
 
 
+#ifndef THREADED_DISPATCH
 u8 cpu_step() {
     ints_handle();
 
@@ -57,8 +62,8 @@ u8 cpu_step() {
     record_cpu_cycle();
 #endif
 
-    cpu.op = mem_read_byte(PC++);
     return op_exec();
 }
+#endif
 
 
@@ -4,6 +4,11 @@
 #include "mem.h"
 #include "defines.h"
 
+// The debugger reads F between any two instructions
+#if defined(LAZY_FLAGS) && defined(DEBUG)
+#undef LAZY_FLAGS
+#endif
+
 #define NORMAL_CPU_FREQ 1048576
 #define DOUBLE_CPU_FREQ 2097152
 
@@ -27,13 +32,26 @@ typedef struct {
     int freq_switch;
     int halted;
 
+#ifdef LAZY_FLAGS
+    /*
+        Operands and result of the last add, sub, inc or dec whose flags
+        haven't been written to F yet, see op_sync_flags()
+    */
+    u8 lazy_op;
+    u8 lazy_a, lazy_b;
+    u16 lazy_r;
+#endif
+
 #ifdef DEBUG
     int dbg_mcs;
 #endif
 } cpu_t;
 
+// Kinds of arithmetic flags, LAZY_SUB carries the N flag
+#define LAZY_NONE 0x00
+#define LAZY_ADD 0x01
+#define LAZY_SUB (0x01 | FNBIT)
 
-extern cpu_t cpu;
 
 void cpu_reset();
 u8 cpu_exec(u8 op);
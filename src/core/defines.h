@@ -5,26 +5,28 @@
 
 typedef int8_t s8;
 typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
 typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
-#define A (cpu.af.b[1])
-#define F (cpu.af.b[0])
-#define B (cpu.bc.b[1])
-#define C (cpu.bc.b[0])
-#define D (cpu.de.b[1])
-#define E (cpu.de.b[0])
-#define H (cpu.hl.b[1])
-#define L (cpu.hl.b[0])
-
-#define AF (cpu.af.w)
-#define BC (cpu.bc.w)
-#define DE (cpu.de.w)
-#define HL (cpu.hl.w)
-#define SP (cpu.sp.w)
-#define PC (cpu.pc.w)
+#define A (CPU.af.b[1])
+#define F (CPU.af.b[0])
+#define B (CPU.bc.b[1])
+#define C (CPU.bc.b[0])
+#define D (CPU.de.b[1])
+#define E (CPU.de.b[0])
+#define H (CPU.hl.b[1])
+#define L (CPU.hl.b[0])
+
+#define AF (CPU.af.w)
+#define BC (CPU.bc.w)
+#define DE (CPU.de.w)
+#define HL (CPU.hl.w)
+#define SP (CPU.sp.w)
+#define PC (CPU.pc.w)
 
 #define FZBIT 0x80
 #define FNBIT 0x40
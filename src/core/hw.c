@@ -10,108 +10,145 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-#include "sys/sdl/input.h"
+#include "instance.h"
 
-hw_t hw;
 
 void hw_reset() {
 #ifdef DEBUG
-    lcd.mode_event[0].dbg_queued = 0;
-    lcd.mode_event[1].dbg_queued = 0;
-    lcd.mode_event[2].dbg_queued = 0;
-    lcd.mode_event[3].dbg_queued = 0;
-    lcd.vblank_line_event.dbg_queued = 0;
-    rtc_event.dbg_queued = 0;
-    sound_mix_event.dbg_queued = 0;
-    sound_envelopes_event.dbg_queued = 0;
-    sound_length_counters_event.dbg_queued = 0;
-    sound_sweep_event.dbg_queued = 0;
-    timers_div_event.dbg_queued = 0;
-    timers_tima_event.dbg_queued = 0;
+    LCD.mode_event[0].dbg_queued = 0;
+    LCD.mode_event[1].dbg_queued = 0;
+    LCD.mode_event[2].dbg_queued = 0;
+    LCD.mode_event[3].dbg_queued = 0;
+    LCD.vblank_line_event.dbg_queued = 0;
+    RTC_EVENT.dbg_queued = 0;
+    SOUND_MIX_EVENT.dbg_queued = 0;
+    SOUND_ENVELOPES_EVENT.dbg_queued = 0;
+    SOUND_LENGTH_COUNTERS_EVENT.dbg_queued = 0;
+    SOUND_SWEEP_EVENT.dbg_queued = 0;
+    TIMERS_DIV_EVENT.dbg_queued = 0;
+    TIMERS_TIMA_EVENT.dbg_queued = 0;
 #endif
 
-    hw.cc = 0;
-    hw.queue = NULL;
-    hw.sched = NULL;
+    HW.cc = 0;
+    HW.invoke_cc = 0;
+    HW.defered = 0;
+    HW.order = 0;
+
+    while(HW.queue_length > 0) {
+        HW.queue[--HW.queue_length]->slot = 0;
+    }
+    HW.root_free = 0;
+    HW.deadline = HW_NO_DEADLINE;
 }
 
-static inline void schedule() {
-    hw_event_t *next_sched, *next, *event, *prev;
-
-    while(hw.sched != NULL) {
-        next_sched = hw.sched->next;
-        prev = NULL;
-
-        for(event = hw.queue; event != NULL;) {
-            next = event->next;
-            assert(next != event);
-
-            if((hw_cycle_t)(hw.sched->mcs - hw.cc) <= (hw_cycle_t)(event->mcs - hw.cc)) {
-                hw.sched->next = event;
-                if(prev == NULL) {
-                    hw.queue = hw.sched;
-                }
-                else {
-                    prev->next = hw.sched;
-                }
-                break;
-            }
+/*
+    Deadlines are compared by their signed difference, so hw_cycle_t may
+    wrap around
+*/
+static inline int before(hw_event_t *a, hw_event_t *b) {
+    s32 diff = a->mcs - b->mcs;
+    return diff != 0 ? diff < 0 : (s32)(a->order - b->order) > 0;
+}
 
-            prev = event;
-            event = next;
-        }
+static inline void place(hw_event_t *event, int index) {
+    HW.queue[index] = event;
+    event->slot = index + 1;
+}
 
-        if(event == NULL) {
-            if(prev == NULL) {
-                hw.queue = hw.sched;
-            }
-            else {
-                prev->next = hw.sched;
-            }
-            hw.sched->next = NULL;
+static void sift_up(int index) {
+    hw_event_t *event = HW.queue[index];
+    int top = HW.root_free ? 1 : 0;
+
+    while(index > top) {
+        int parent = (index - 1) / 2;
+        if(!before(event, HW.queue[parent])) {
+            break;
         }
-        hw.sched = next_sched;
+        place(HW.queue[parent], index);
+        index = parent;
     }
+    place(event, index);
 }
 
-static void poll_queue(int mcs) {
-    hw_event_t *next;
+static void sift_down(int index) {
+    hw_event_t *event = HW.queue[index];
 
-    hw.cc += mcs;
-
-    while(hw.queue != NULL) {
-        hw_cycle_t dist = hw.cc - hw.queue->mcs;
-        if(dist <= mcs) {
-            next = hw.queue->next;
-#ifdef DEBUG
-            assert(hw.queue->dbg_queued);
-            hw.queue->dbg_queued = 0;
-#endif
-            hw.queue->callback(dist);
-            hw.queue = next;
+    for(;;) {
+        int child = index * 2 + 1;
+        if(child >= HW.queue_length) {
+            break;
+        }
+        if(child + 1 < HW.queue_length && before(HW.queue[child + 1], HW.queue[child])) {
+            child++;
         }
-        else {
+        if(!before(HW.queue[child], event)) {
             break;
         }
+        place(HW.queue[child], index);
+        index = child;
     }
+    place(event, index);
+}
 
-    if(hw.defered > 0) {
-        hw_cycle_t mcs = hw.defered;
-        hw.defered = 0;
-        hw_step(mcs);
+static void remove_at(int index) {
+    hw_event_t *last = HW.queue[--HW.queue_length];
+
+    HW.queue[index]->slot = 0;
+    if(index < HW.queue_length) {
+        place(last, index);
+        sift_down(index);
+        if(last->slot - 1 == index) {
+            sift_up(index);
+        }
     }
 }
 
-void hw_step(int mcs) {
-#ifdef DEBUG
-    assert(mcs <= 10);
-    cpu.dbg_mcs += mcs;
-#endif
+/*
+    Most callbacks reschedule their own event, which then simply takes
+    over the root slot instead of being removed and inserted again
+*/
+static void fill_root() {
+    if(HW.root_free) {
+        HW.root_free = 0;
+        remove_at(0);
+    }
+}
+
+static inline void update_deadline() {
+    if(HW.defered > 0) {
+        HW.deadline = HW.cc;
+    }
+    else {
+        HW.deadline = HW.queue_length > 0 ? HW.queue[0]->mcs : HW.cc + HW_NO_DEADLINE;
+    }
+}
 
-    schedule();
-    poll_queue(mcs);
+void hw_poll() {
+    for(;;) {
+        while(HW.queue_length > 0) {
+            hw_event_t *event = HW.queue[0];
+            hw_cycle_t dist = HW.cc - event->mcs;
 
-    sys.invoke_cc += mcs;
+            if((s32)dist < 0) {
+                break;
+            }
+
+#ifdef DEBUG
+            assert(event->dbg_queued);
+            event->dbg_queued = 0;
+#endif
+            event->slot = 0;
+            HW.root_free = 1;
+            event->callback(dist);
+            fill_root();
+        }
+        if(HW.defered == 0) {
+            break;
+        }
+        HW.cc += HW.defered;
+        HW.defered = 0;
+    }
+    update_deadline();
 }
 
 void hw_schedule(hw_event_t *sched, int mcs) {
@@ -122,25 +159,21 @@ void hw_schedule(hw_event_t *sched, int mcs) {
     }
     sched->dbg_queued = 1;
 #endif
+    assert(sched->slot == 0 && (HW.root_free || HW.queue_length < HW_MAX_EVENTS));
 
-    sched->mcs = hw.cc + mcs;
-    sched->next = hw.sched;
-    hw.sched = sched;
-}
+    sched->mcs = HW.cc + mcs;
+    sched->order = HW.order++;
 
-static void unschedule_from_queue(hw_event_t **q, hw_event_t *del) {
-    hw_event_t *event, *prev;
-    for(event = *q, prev = NULL; event != NULL; event = event->next) {
-        if(event == del) {
-            if(prev != NULL) {
-                prev->next = event->next;
-            }
-            else {
-                *q = event->next;
-            }
-        }
-        prev = event;
+    if(HW.root_free) {
+        HW.root_free = 0;
+        place(sched, 0);
+        sift_down(0);
+    }
+    else {
+        place(sched, HW.queue_length++);
+        sift_up(HW.queue_length - 1);
     }
+    update_deadline();
 }
 
 void hw_unschedule(hw_event_t *del) {
@@ -148,11 +181,13 @@ void hw_unschedule(hw_event_t *del) {
     del->dbg_queued = 0;
 #endif
 
-    unschedule_from_queue(&hw.queue, del);
-    unschedule_from_queue(&hw.sched, del);
+    if(del->slot != 0) {
+        remove_at(del->slot - 1);
+        update_deadline();
+    }
 }
 
 void hw_defer(hw_cycle_t mcs) {
-    hw.defered += mcs;
+    HW.defered += mcs;
+    HW.deadline = HW.cc; // Poll on the next step at the latest
 }
-
@@ -5,10 +5,14 @@
 
 typedef u32 hw_cycle_t;
 
+#define HW_MAX_EVENTS 16
+#define HW_NO_DEADLINE 0x7FFFFFFF
+
 typedef struct hw_event_s {
     void (*callback)(int);
-    struct hw_event_s *next;
     hw_cycle_t mcs;
+    u32 order; // Breaks ties, later scheduled events run first
+    int slot; // Position in the queue + 1, 0 if not queued
 #ifdef DEBUG
     char name[64];
     int dbg_queued;
@@ -18,16 +22,41 @@ typedef struct hw_event_s {
 
 typedef struct {
     hw_cycle_t cc;
+    int invoke_cc;
     hw_cycle_t defered;
-    hw_event_t *queue, *sched;
-} hw_t;
 
-extern hw_t hw;
+    // Binary min-heap ordered by mcs, deadline caches the root's mcs
+    hw_event_t *queue[HW_MAX_EVENTS];
+    int queue_length;
+    int root_free; // The root's event is being fired, its slot can be reused
+    hw_cycle_t deadline;
+    u32 order;
+} hw_t;
 
 
 void hw_reset();
 
-void hw_step(int mcs);
+void hw_poll();
+
+/*
+    Advances the clock. Only once the earliest event is due the queue gets
+    polled, so straight-line code runs without touching the scheduler.
+    Expects instance.h to be included by the caller
+*/
+#ifdef DEBUG
+#define HW_STEP_CHECK(mcs) assert((mcs) <= 10); CPU.dbg_mcs += (mcs);
+#else
+#define HW_STEP_CHECK(mcs)
+#endif
+
+#define hw_step(mcs) do { \
+        hw_cycle_t step_mcs = (mcs); \
+        HW_STEP_CHECK(step_mcs) \
+        HW.cc += step_mcs; \
+        if((s32)(HW.cc - HW.deadline) >= 0) { \
+            hw_poll(); \
+        } \
+    } while(0)
 
 void hw_schedule(hw_event_t *event, int mcs);
 void hw_unschedule(hw_event_t *del);
@@ -0,0 +1,34 @@
+#include "instance.h"
+#include <stdlib.h>
+
+/*
+    The default instance keeps single-instance frontends working without
+    ever calling moo_instance_create().
+*/
+
+static moo_instance_t default_instance;
+
+__thread moo_instance_t *moo_instance = &default_instance;
+
+moo_instance_t *moo_instance_create() {
+    return calloc(1, sizeof(moo_instance_t));
+}
+
+void moo_instance_destroy(moo_instance_t *instance) {
+    moo_instance_t *selected = moo_instance;
+
+    if(instance == NULL) {
+        return;
+    }
+
+    moo_instance = instance;
+    free(CARD.rombanks);
+    render_disable();
+
+    moo_instance = selected != instance ? selected : &default_instance;
+    free(instance);
+}
+
+void moo_instance_select(moo_instance_t *instance) {
+    moo_instance = instance != NULL ? instance : &default_instance;
+}
@@ -0,0 +1,100 @@
+#ifndef CORE_INSTANCE_H
+#define CORE_INSTANCE_H
+
+#include "defines.h"
+#include "moo.h"
+#include "cpu.h"
+#include "hw.h"
+#include "mem.h"
+#include "lcd.h"
+#include "mbc.h"
+#include "rtc.h"
+#include "timers.h"
+#include "sound.h"
+#include "joy.h"
+#include "render.h"
+
+/*
+    All state of one emulated Gameboy. The core accesses it through
+    moo_instance, which is thread local, so several instances may run
+    side by side as long as each thread selects its own. Its parts are
+    reached through the uppercase accessors below, e.g. CPU.pc or LCD.ly.
+*/
+
+typedef struct {
+    moo_t moo;
+    cpu_t cpu;
+    hw_t hw;
+    ram_t ram;
+    card_t card;
+    lcd_t lcd;
+
+    mbc_t mbc;
+    mbc1_t mbc1;
+    mbc3_t mbc3;
+    mbc5_t mbc5;
+
+    rtc_t rtc;
+    hw_event_t rtc_event;
+
+    timers_t timers;
+    hw_event_t timers_div_event;
+    hw_event_t timers_tima_event;
+
+    sound_t sound;
+    sqw_t sqw[2];
+    env_t env[3];
+    sweep_t sweep;
+    wave_t wave;
+    noise_t noise;
+    hw_event_t sound_mix_event;
+    hw_event_t sound_length_counters_event;
+    hw_event_t sound_sweep_event;
+    hw_event_t sound_envelopes_event;
+
+    joy_t joy;
+
+    render_t *renderer; // NULL unless lines are drawn on a thread of their own
+} moo_instance_t;
+
+extern __thread moo_instance_t *moo_instance;
+
+#define MOO (moo_instance->moo)
+#define CPU (moo_instance->cpu)
+#define HW (moo_instance->hw)
+#define RAM (moo_instance->ram)
+#define CARD (moo_instance->card)
+#define LCD (moo_instance->lcd)
+
+#define MBC (moo_instance->mbc)
+#define MBC1 (moo_instance->mbc1)
+#define MBC3 (moo_instance->mbc3)
+#define MBC5 (moo_instance->mbc5)
+
+#define RTC (moo_instance->rtc)
+#define RTC_EVENT (moo_instance->rtc_event)
+
+#define TIMERS (moo_instance->timers)
+#define TIMERS_DIV_EVENT (moo_instance->timers_div_event)
+#define TIMERS_TIMA_EVENT (moo_instance->timers_tima_event)
+
+#define SOUND (moo_instance->sound)
+#define SQW (moo_instance->sqw)
+#define ENV (moo_instance->env)
+#define SWEEP (moo_instance->sweep)
+#define WAVE (moo_instance->wave)
+#define NOISE (moo_instance->noise)
+#define SOUND_MIX_EVENT (moo_instance->sound_mix_event)
+#define SOUND_LENGTH_COUNTERS_EVENT (moo_instance->sound_length_counters_event)
+#define SOUND_SWEEP_EVENT (moo_instance->sound_sweep_event)
+#define SOUND_ENVELOPES_EVENT (moo_instance->sound_envelopes_event)
+
+#define JOY (moo_instance->joy)
+
+#define RENDERER (moo_instance->renderer)
+
+moo_instance_t *moo_instance_create();
+void moo_instance_destroy(moo_instance_t *instance);
+void moo_instance_select(moo_instance_t *instance);
+
+#endif
@@ -6,12 +6,13 @@
 #include "cpu.h"
 #include "defines.h"
 #include "hw.h"
+#include "instance.h"
 
 static inline void exec_int(u8 i) {
     hw_step(2);
 
-    cpu.irq &= ~(1 << i);
-    cpu.ime = IME_OFF;
+    CPU.irq &= ~(1 << i);
+    CPU.ime = IME_OFF;
 
     SP -= 2;
     mem_write_word(SP, PC);
@@ -24,19 +25,19 @@ static inline void exec_int(u8 i) {
 }
 
 void ints_handle() {
-    switch(cpu.ime) {
+    switch(CPU.ime) {
         case IME_ON: break;
-        case IME_UP: cpu.ime = IME_ON; return;
-        case IME_DOWN: cpu.ime = IME_OFF; return;
+        case IME_UP: CPU.ime = IME_ON; return;
+        case IME_DOWN: CPU.ime = IME_OFF; return;
         case IME_OFF: return;
         default:
             assert(0);
     }
 
-    if((cpu.irq & cpu.ie) != 0x00) {
+    if((CPU.irq & CPU.ie) != 0x00) {
         int i;
         for(i = 0; i < 5; i++) {
-            if(cpu.irq & cpu.ie & (1 << i)) {
+            if(CPU.irq & CPU.ie & (1 << i)) {
                 exec_int(i);
                 return;
             }
@@ -45,11 +46,11 @@ void ints_handle() {
 }
 
 int ints_handle_standby() {
-    if((cpu.irq & cpu.ie) != 0x00) {
+    if((CPU.irq & CPU.ie) != 0x00) {
         int i;
         for(i = 0; i < 5; i++) {
-            if(cpu.irq & cpu.ie & (1 << i)) {
-                if(cpu.ime != IME_OFF) {
+            if(CPU.irq & CPU.ie & (1 << i)) {
+                if(CPU.ime != IME_OFF) {
                     exec_int(i);
                 }
                 return 1;
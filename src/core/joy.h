@@ -20,7 +20,6 @@ typedef struct {
     u8 col;
 } joy_t;
 
-extern joy_t joy;
 
 void joy_reset();
 
@@ -9,19 +9,21 @@
 #include "defines.h"
 #include "obj.h"
 #include "maps.h"
+#include "render.h"
+#include "instance.h"
 
-#define DUR_MODE_0 (51 * cpu.freq_factor)
-#define DUR_MODE_2 (20 * cpu.freq_factor)
-#define DUR_MODE_3 (43 * cpu.freq_factor)
-#define DUR_SCANLINE (114 * cpu.freq_factor)
+#define DUR_MODE_0 (51 * CPU.freq_factor)
+#define DUR_MODE_2 (20 * CPU.freq_factor)
+#define DUR_MODE_3 (43 * CPU.freq_factor)
+#define DUR_SCANLINE (114 * CPU.freq_factor)
 
 #define SIF_HBLANK 0x08
 #define SIF_VBLANK 0x10
 #define SIF_OAM    0x20
 #define SIF_LYC    0x40
 
-#define STAT_SET_MODE(m)  (lcd.stat = (lcd.stat & 0xFC) | (m))
-#define STAT_SET_CFLAG(c) (lcd.stat = (lcd.stat & 0xFB) | ((c) << 2))
+#define STAT_SET_MODE(m)  (LCD.stat = (LCD.stat & 0xFC) | (m))
+#define STAT_SET_CFLAG(c) (LCD.stat = (LCD.stat & 0xFB) | ((c) << 2))
 
 #define TILE_BYTES 16
 #define TILE_LINE_BYTES 2
@@ -35,25 +37,22 @@
 #define MAP_ROWS 32
 
 
-lcd_t lcd;
-
-
 static void unschedule() {
     int e;
     for(e = 0; e < 4; e++) {
-        hw_unschedule(&lcd.mode_event[e]);
+        hw_unschedule(&LCD.mode_event[e]);
     }
-    hw_unschedule(&lcd.vblank_line_event);
+    hw_unschedule(&LCD.vblank_line_event);
 }
 
 static inline void stat_irq(u8 flag) {
-    if((lcd.c & LCDC_DISPLAY_ENABLE_BIT) && (lcd.stat & flag)) {
-        cpu.irq |= IF_LCDSTAT;
+    if((LCD.c & LCDC_DISPLAY_ENABLE_BIT) && (LCD.stat & flag)) {
+        CPU.irq |= IF_LCDSTAT;
     }
 }
 
 static void check_coincidence() {
-    if(lcd.ly == lcd.lyc) {
+    if(LCD.ly == LCD.lyc) {
         stat_irq(SIF_LYC);
         STAT_SET_CFLAG(1);
     }
@@ -62,14 +61,32 @@ static void check_coincidence() {
     }
 }
 
+#define FB_INDEX 0x03
+#define FB_FRESH 0x80
+
+// Publishes the drawn frame and continues in the one it replaced
 static void swap_fb() {
-    u16 *tmp = lcd.clean_fb;
-    lcd.clean_fb = lcd.working_fb;
-    lcd.working_fb = tmp;
+    u8 completed = LCD.fb_working;
+
+#ifdef RENDER_THREAD
+    if(RENDERER != NULL) {
+        render_sync();
+    }
+#endif
+
+    LCD.fb_working = __atomic_exchange_n(&LCD.fb_ready, completed | FB_FRESH, __ATOMIC_ACQ_REL) & FB_INDEX;
+    LCD.clean_fb = LCD.fb[completed];
+    LCD.working_fb = LCD.fb[LCD.fb_working];
+
+#ifdef RENDER_THREAD
+    if(RENDERER != NULL) {
+        render_set_fb(LCD.working_fb);
+    }
+#endif
 }
 
 static inline int cgb_priority(int maps_color_id, int maps_priority, int obj_color_id, int obj_priority) {
-    int bg_priority = (lcd.c & LCDC_BG_ENABLE_BIT) && (maps_priority || obj_priority);
+    int bg_priority = (LCD.c & LCDC_BG_ENABLE_BIT) && (maps_priority || obj_priority);
     return (bg_priority && maps_color_id != 0) || obj_color_id == 0;
 }
 
@@ -77,12 +94,12 @@ static inline int dmg_priority(int maps_color_id, int maps_priority, int obj_col
     return (obj_priority && maps_color_id != 0) || obj_color_id == 0;
 }
 
-static void draw_line() {
+void lcd_draw_line() {
     u16 obj_scan[160], maps_scan[160];
     pixel_meta_t obj_meta[160], maps_meta[160];
     obj_range_t obj_ranges[11];
     int x, r;
-    u16 *pixel = &lcd.working_fb[lcd.ly * LCD_WIDTH];
+    u16 *pixel = &LCD.working_fb[LCD.ly * LCD_WIDTH];
     int (*priority_func)(int, int, int, int);
     int num_obj_ranges;
 
@@ -91,10 +108,10 @@ static void draw_line() {
 
     lcd_scan_maps(maps_scan, maps_meta);
 
-    if(lcd.c & LCDC_OBJ_ENABLE_BIT) {
+    if(LCD.c & LCDC_OBJ_ENABLE_BIT) {
         lcd_scan_obj(obj_scan, obj_meta, obj_ranges, &num_obj_ranges);
 
-        priority_func = moo.mode == CGB_MODE ? cgb_priority : dmg_priority;
+        priority_func = MOO.mode == CGB_MODE ? cgb_priority : dmg_priority;
 
         for(x = 0, r = 0; r < num_obj_ranges; r++) {
             memcpy(pixel, &maps_scan[x], obj_ranges[r].diff * sizeof(*pixel));
@@ -132,60 +149,71 @@ static void draw_line() {
     }
 }
 
-inline void hdma() {
+static inline void hdma() {
     u16 end;
 
     hw_defer(8);
 
-    for(end = lcd.hdma_source + 0x10; lcd.hdma_source < end; lcd.hdma_source++, lcd.hdma_dest++) {
-        mem_write_byte(lcd.hdma_dest, mem_read_byte(lcd.hdma_source));
+    for(end = LCD.hdma_source + 0x10; LCD.hdma_source < end; LCD.hdma_source++, LCD.hdma_dest++) {
+        mem_write_byte(LCD.hdma_dest, mem_read_byte(LCD.hdma_source));
     }
 
-    if(lcd.hdma_length == 0x00) {
-        lcd.hdma_length = 0x7F;
-        lcd.hdma_inactive = 0x80;
+    if(LCD.hdma_length == 0x00) {
+        LCD.hdma_length = 0x7F;
+        LCD.hdma_inactive = 0x80;
     }
     else {
-        lcd.hdma_length--;
+        LCD.hdma_length--;
     }
 }
 
 static void next_line() {
-    lcd.ly++;
-    lcd.ly %= 154;
+    LCD.ly++;
+    LCD.ly %= 154;
 
     check_coincidence();
 }
 
 static void vblank_line(int mcs) {
     next_line();
-    hw_schedule(lcd.ly == 153 ? &lcd.mode_event[2] : &lcd.vblank_line_event, DUR_SCANLINE - mcs);
+    hw_schedule(LCD.ly == 153 ? &LCD.mode_event[2] : &LCD.vblank_line_event, DUR_SCANLINE - mcs);
 }
 
 static void mode_0(int mcs) {
     STAT_SET_MODE(0);
+    mem_update_vram_pages();
     stat_irq(SIF_HBLANK);
 
-    if(lcd.c & LCDC_DISPLAY_ENABLE_BIT) {
-        draw_line();
+    if((LCD.c & LCDC_DISPLAY_ENABLE_BIT) && LCD.draw_frame) {
+#ifdef RENDER_THREAD
+        if(RENDERER != NULL) {
+            render_line();
+        }
+        else
+#endif
+        lcd_draw_line();
     }
-    if(!lcd.hdma_inactive) {
+    if(!LCD.hdma_inactive) {
         hdma();
     }
 
-    hw_schedule(lcd.ly == 143 ? &lcd.mode_event[1] : &lcd.mode_event[2], DUR_MODE_0 - mcs);
+    hw_schedule(LCD.ly == 143 ? &LCD.mode_event[1] : &LCD.mode_event[2], DUR_MODE_0 - mcs);
 }
 
 static void mode_1(int mcs) {
     next_line();
     STAT_SET_MODE(1);
 
-    cpu.irq |= IF_VBLANK;
+    CPU.irq |= IF_VBLANK;
     stat_irq(SIF_VBLANK);
-    sys_fb_ready();
-    swap_fb();
+    if(LCD.draw_frame) {
+        sys_fb_ready();
+        swap_fb();
+    }
+    LCD.frames++;
+    LCD.draw_frame = sys_draw_frame();
 
-    hw_schedule(&lcd.vblank_line_event, DUR_SCANLINE - mcs);
+    hw_schedule(&LCD.vblank_line_event, DUR_SCANLINE - mcs);
 }
 
 static void mode_2(int mcs) {
@@ -194,55 +222,73 @@ static void mode_2(int mcs) {
 
     stat_irq(SIF_OAM);
 
-    hw_schedule(&lcd.mode_event[3], DUR_MODE_2 - mcs);
+    hw_schedule(&LCD.mode_event[3], DUR_MODE_2 - mcs);
 }
 
 static void mode_3(int mcs) {
     STAT_SET_MODE(3);
-    hw_schedule(&lcd.mode_event[0], DUR_MODE_3 - mcs);
+    mem_update_vram_pages();
+    hw_schedule(&LCD.mode_event[0], DUR_MODE_3 - mcs);
+}
+
+u16 *lcd_present_fb() {
+    if(__atomic_load_n(&LCD.fb_ready, __ATOMIC_ACQUIRE) & FB_FRESH) {
+        LCD.fb_presented = __atomic_exchange_n(&LCD.fb_ready, LCD.fb_presented, __ATOMIC_ACQ_REL) & FB_INDEX;
+    }
+    return LCD.fb[LCD.fb_presented];
+}
+
+void lcd_reset_fb() {
+    LCD.fb_ready = 0;
+    LCD.fb_working = 1;
+    LCD.fb_presented = 2;
+    LCD.clean_fb = LCD.fb[LCD.fb_ready];
+    LCD.working_fb = LCD.fb[LCD.fb_working];
 }
 
 void lcd_reset() {
-    memset(&lcd, 0x00, sizeof(lcd));
+    memset(&LCD, 0x00, sizeof(LCD));
 
-    lcd.c = 0x91;
-    lcd.stat = 0x81;
-    lcd.ly = 0x90;
+    LCD.c = 0x91;
+    LCD.stat = 0x81;
+    LCD.ly = 0x90;
 
-    lcd.hdma_dest = 0x8000;
-    lcd.hdma_inactive = 0x80;
+    LCD.hdma_dest = 0x8000;
+    LCD.hdma_inactive = 0x80;
 
-    lcd.clean_fb = lcd.fb[0];
-    lcd.working_fb = lcd.fb[1];
+    lcd_reset_fb();
+    LCD.draw_frame = 1;
 
-    lcd.bgp.b[0] = 0xFC;
-    lcd.obp.b[0] = 0xFF;
-    lcd.obp.b[1] = 0xFF;
+    LCD.bgp.b[0] = 0xFC;
+    LCD.obp.b[0] = 0xFF;
+    LCD.obp.b[1] = 0xFF;
     lcd_rebuild_palette_maps();
 
-    lcd.maps[0].tiles = &ram.vrambanks[0][0x1800];
-    lcd.maps[0].attr = &ram.vrambanks[1][0x1800];
-    lcd.maps[1].tiles = &ram.vrambanks[0][0x1C00];
-    lcd.maps[1].attr = &ram.vrambanks[1][0x1C00];
+    LCD.maps[0].tiles = &RAM.vrambanks[0][0x1800];
+    LCD.maps[0].attr = &RAM.vrambanks[1][0x1800];
+    LCD.maps[1].tiles = &RAM.vrambanks[0][0x1C00];
+    LCD.maps[1].attr = &RAM.vrambanks[1][0x1C00];
+    maps_rebuild_refs();
+    obj_dirty();
 
-    lcd.mode_event[0].callback = mode_0;
-    lcd.mode_event[1].callback = mode_1;
-    lcd.mode_event[2].callback = mode_2;
-    lcd.mode_event[3].callback = mode_3;
-    lcd.vblank_line_event.callback = vblank_line;
+    LCD.mode_event[0].callback = mode_0;
+    LCD.mode_event[1].callback = mode_1;
+    LCD.mode_event[2].callback = mode_2;
+    LCD.mode_event[3].callback = mode_3;
+    LCD.vblank_line_event.callback = vblank_line;
 
 #ifdef DEBUG
-    sprintf(lcd.mode_event[0].name, "lcd-mode-0");
-    sprintf(lcd.mode_event[1].name, "lcd-mode-1");
-    sprintf(lcd.mode_event[2].name, "lcd-mode-2");
-    sprintf(lcd.mode_event[3].name, "lcd-mode-3");
-    sprintf(lcd.vblank_line_event.name, "vblank_line");
+    sprintf(LCD.mode_event[0].name, "lcd-mode-0");
+    sprintf(LCD.mode_event[1].name, "lcd-mode-1");
+    sprintf(LCD.mode_event[2].name, "lcd-mode-2");
+    sprintf(LCD.mode_event[3].name, "lcd-mode-3");
+    sprintf(LCD.vblank_line_event.name, "vblank_line");
 #endif
 }
 
 void lcd_begin() {
     unschedule();
-    hw_schedule(&lcd.vblank_line_event, DUR_MODE_0 + DUR_MODE_2);
+    hw_schedule(&LCD.vblank_line_event, DUR_MODE_0 + DUR_MODE_2);
 
     maps_dirty();
 }
@@ -252,8 +298,14 @@ void lcd_dma(u8 v) {
     u16 src;
 
     for(src = ((u16)v)<<8, b = 0; b < 0xA0; b++, src++) {
-        ram.oam[b] = mem_read_byte(src);
+        RAM.oam[b] = mem_read_byte(src);
+#ifdef RENDER_THREAD
+        if(RENDERER != NULL) {
+            render_oam_write(b, RAM.oam[b]);
+        }
+#endif
     }
+    obj_dirty();
 }
 
 void lcd_gdma() {
@@ -261,100 +313,110 @@ void lcd_gdma() {
     u16 length, source, dest, end;
 
 
-    for(d = 0; d <= lcd.hdma_length; d++) {
+    for(d = 0; d <= LCD.hdma_length; d++) {
         hw_step(8);
     }
 
-    length = (lcd.hdma_length + 1) * 0x10;
-    source = lcd.hdma_source;
-    dest = lcd.hdma_dest;
+    length = (LCD.hdma_length + 1) * 0x10;
+    source = LCD.hdma_source;
+    dest = LCD.hdma_dest;
     end = source + length;
 
     for(; source < end; source++, dest++) {
         mem_write_byte(dest, mem_read_byte(source));
     }
 
-    lcd.hdma_length = 0x7F;
-    lcd.hdma_inactive = 0x80;
+    LCD.hdma_length = 0x7F;
+    LCD.hdma_inactive = 0x80;
 }
 
 void lcd_hdma_control(u8 val) {
-    lcd.hdma_length = val & 0x7F;
+    LCD.hdma_length = val & 0x7F;
     if(val & 0x80) {
-        lcd.hdma_inactive = 0x00;
+        LCD.hdma_inactive = 0x00;
     }
     else {
-        if(lcd.hdma_inactive) {
+        if(LCD.hdma_inactive) {
             lcd_gdma();
-            lcd.hdma_length = 0x7F;
+            LCD.hdma_length = 0x7F;
         }
-        lcd.hdma_inactive = 0x80;
+        LCD.hdma_inactive = 0x80;
     }
 }
 
 void lcd_enable() {
-    lcd.stat = (lcd.stat & 0xF8) | 0x04;
+    LCD.stat = (LCD.stat & 0xF8) | 0x04;
     unschedule();
-    lcd.ly = -1;
+    LCD.ly = -1;
     mode_2(1);
 }
 
 void lcd_disable() {
-    lcd.ly = 0;
+    LCD.ly = 0;
     check_coincidence();
-    lcd.stat = (lcd.stat & 0xF8) | 0x00;
+    LCD.stat = (LCD.stat & 0xF8) | 0x00;
     unschedule();
 }
 
 void lcd_set_lyc(u8 lyc) {
-    lcd.lyc = lyc;
+    LCD.lyc = lyc;
     check_coincidence();
 }
 
 void lcd_reset_ly() {
-    lcd.ly = 0x00;
+    LCD.ly = 0x00;
     check_coincidence();
 }
 
 void lcd_c_write(u8 val) {
-    if(!(lcd.c & val & 0x80)) {
+    if(!(LCD.c & val & 0x80)) {
         if(val & 0x80) {
             lcd_enable();
         }
-        else if(lcd.c & 0x80) {
+        else if(LCD.c & 0x80) {
             lcd_disable();
         }
     }
 
-    if((lcd.c & 0x10) != (val & 0x10)) {
+    if((LCD.c & 0x10) != (val & 0x10)) {
         maps_dirty();
     }
+    if((LCD.c & LCDC_OBJ_SIZE_BIT) != (val & LCDC_OBJ_SIZE_BIT)) {
+        obj_dirty();
+    }
 
-    lcd.c = val;
+    LCD.c = val;
+    mem_update_vram_pages();
 }
 
 void lcd_vram_write(u16 adr, u8 val) {
     u16 vram_adr = adr - 0x8000;
 
-    if(val == ram.vrambanks[ram.selected_vrambank][vram_adr]) {
+    if(val == RAM.vrambanks[RAM.selected_vrambank][vram_adr]) {
         return;
     }
 
-    ram.vrambanks[ram.selected_vrambank][vram_adr] = val;
+    RAM.vrambanks[RAM.selected_vrambank][vram_adr] = val;
+
+#ifdef RENDER_THREAD
+    if(RENDERER != NULL) {
+        render_vram_write(RAM.selected_vrambank, vram_adr, val);
+    }
+#endif
 
     if(vram_adr >= 0x0000 && vram_adr < 0x1800) {
         maps_tiledata_dirty(vram_adr/16);
     }
     else if(vram_adr >= 0x1800 && vram_adr < 0x1C00) {
-        maps_tile_dirty(&lcd.maps[0], vram_adr - 0x1800);
+        maps_tile_dirty(&LCD.maps[0], vram_adr - 0x1800);
     }
     else if(vram_adr >= 0x1C00) {
-        maps_tile_dirty(&lcd.maps[1], vram_adr - 0x1C00);
+        maps_tile_dirty(&LCD.maps[1], vram_adr - 0x1C00);
     }
 }
 
 static void update_cgb_palettes_map(lcd_palettes_t *palettes, u8 s) {
-    u16 palette, color_id, d;
+    u16 palette, color_id, d, color;
 
     palette = s/8;
     color_id = (s/2)%4;
@@ -366,28 +428,45 @@ static void update_cgb_palettes_map(lcd_palettes_t *palettes, u8 s) {
         d = palettes->d[s] | palettes->d[s+1] << 8;
     }
 
-    palettes->map[palette][color_id] = sys_map_cgb_color(d);
+    color = d;
+
+    if(palettes == &LCD.bgp && palettes->map[palette][color_id] != color) {
+        maps_palette_changed();
+    }
+    palettes->map[palette][color_id] = color;
 }
 
 static void update_dmg_palettes_map(lcd_palettes_t *palettes, u8 s) {
+    static const u16 shades[] = {0x7FFF, 0x4E73, 0x1CE7, 0x0000};
     u8 rc;
+    int changed = 0;
 
     for(rc = 0; rc < 4; rc++) {
-        palettes->map[s][rc] = sys_map_dmg_color((palettes->b[s] & (0x3 << (rc<<1))) >> (rc<<1));
+        u16 color = shades[(palettes->b[s] & (0x3 << (rc<<1))) >> (rc<<1)];
+        changed |= palettes->map[s][rc] != color;
+        palettes->map[s][rc] = color;
+    }
+
+    if(palettes == &LCD.bgp && changed) {
+        maps_palette_changed();
     }
-    maps_dirty();
 }
 
 void lcd_palette_control(lcd_palettes_t *palettes, u8 val) {
-    if(moo.mode == CGB_MODE) {
+    if(MOO.mode == CGB_MODE) {
         palettes->s = val & 0x3F;
         palettes->i = val & 0x80;
     }
 }
 
 void lcd_cgb_palette_data(lcd_palettes_t *palettes, u8 val) {
-    if(moo.mode == CGB_MODE) {
+    if(MOO.mode == CGB_MODE) {
         palettes->d[palettes->s] = palettes->s & 0x01 ? val&0x7F : val;
+#ifdef RENDER_THREAD
+        if(RENDERER != NULL) {
+            render_cgb_palette_data(palettes == &LCD.obp, palettes->s, val);
+        }
+#endif
 
         update_cgb_palettes_map(palettes, palettes->s);
 
@@ -400,23 +479,28 @@ void lcd_cgb_palette_data(lcd_palettes_t *palettes, u8 val) {
 
 void lcd_dmg_palette_data(lcd_palettes_t *palettes, u8 val, u8 s) {
     palettes->b[s] = val;
-    if(moo.mode == NON_CGB_MODE) {
+#ifdef RENDER_THREAD
+    if(RENDERER != NULL) {
+        render_dmg_palette_data(palettes == &LCD.obp, s, val);
+    }
+#endif
+    if(MOO.mode == NON_CGB_MODE) {
         update_dmg_palettes_map(palettes, s);
     }
 }
 
 void lcd_rebuild_palette_maps() {
-    if(moo.mode == CGB_MODE) {
+    if(MOO.mode == CGB_MODE) {
         int i;
         for(i = 0; i < 0x40; i++) {
-            update_cgb_palettes_map(&lcd.bgp, i);
-            update_cgb_palettes_map(&lcd.obp, i);
+            update_cgb_palettes_map(&LCD.bgp, i);
+            update_cgb_palettes_map(&LCD.obp, i);
         }
     }
     else {
-        update_dmg_palettes_map(&lcd.bgp, 0);
-        update_dmg_palettes_map(&lcd.obp, 0);
-        update_dmg_palettes_map(&lcd.obp, 1);
+        update_dmg_palettes_map(&LCD.bgp, 0);
+        update_dmg_palettes_map(&LCD.obp, 0);
+        update_dmg_palettes_map(&LCD.obp, 1);
     }
 }
 
@@ -18,6 +18,10 @@
 
 #define LCD_WIDTH 160
 #define LCD_HEIGHT 144
+#define LCD_FRAMERATE 59.73
+
+#define OAM_OBJ_COUNT 40
+#define MAX_PER_LINE 10
 
 
 typedef struct {
@@ -26,21 +30,29 @@ typedef struct {
 } pixel_meta_t;
 
 typedef struct {
+#ifndef PACKED_MAPS
     u16 scan_cache[256][256];
     pixel_meta_t cache_meta[256][256];
     u32 cached_palette[32][32][2];
     int tile_dirty[32][32];
+#endif
 
     u8 *tiles;
     u8 *attr;
 } lcd_map_t;
 
+// A map cell's entry in the list of cells referencing the same tile
+typedef struct {
+    u16 next, prev;
+    u16 key; // bank << 8 | tile index
+} map_ref_t;
+
 typedef struct {
     u8 s;
     u8 i;
     u8 b[2];
     u8 d[0x40];
-    u16 map[8][4];
+    u16 map[8][4]; // 15 bit CGB colors, DMG shades are mapped to grays
 } lcd_palettes_t;
 
 typedef struct {
@@ -54,10 +66,16 @@ typedef struct {
     // Palettes
     lcd_palettes_t bgp, obp;
 
-    // Framebuffer
-    u16 fb[2][144*160];
-    u16 *clean_fb;
+    // Framebuffer of 15 bit CGB colors, tripled so neither the core nor the
+    // presenter waits for the other: One is drawn into, one holds the latest
+    // complete frame and one is being presented
+    u16 fb[3][144*160];
+    u16 *clean_fb; // Latest complete frame
     u16 *working_fb;
+    u8 fb_ready; // Index of the latest complete frame, FB_FRESH until presented
+    u8 fb_working, fb_presented;
+    u32 frames; // Completed frames, counted at vblank
+    u8 draw_frame; // Skipped frames aren't drawn and don't replace clean_fb
 
     // DMA
     u16 hdma_source, hdma_dest;
@@ -65,7 +83,23 @@ typedef struct {
 
     // Caching
     lcd_map_t maps[2];
+#ifndef PACKED_MAPS
     int index_dirty[2][256];
+    u16 index_refs[0x200]; // First cell of both maps referencing a tile, by key
+    map_ref_t map_refs[2048];
+
+    // Composing lines directly while palettes change mid-frame, see maps.c
+    u8 direct_maps;
+    u8 palette_changed;
+    u8 palette_lines;
+    u8 stable_frames;
+#endif
+
+    // Objects on each line, see obj.c
+    u8 obj_lines[LCD_HEIGHT][OAM_OBJ_COUNT];
+    u8 obj_lines_drawn[LCD_HEIGHT][MAX_PER_LINE];
+    u8 obj_lines_size[LCD_HEIGHT];
+    u8 obj_lines_dirty;
 
     // HW events
     hw_event_t mode_event[4];
@@ -73,10 +107,8 @@ typedef struct {
 } lcd_t;
 
 
-extern lcd_t lcd;
-
-
 void lcd_reset();
+void lcd_reset_fb(); // Back to the framebuffer indices lcd_reset() starts with
 void lcd_begin();
 
 void lcd_dma(u8 v);
@@ -88,6 +120,11 @@ void lcd_disable();
 void lcd_set_lyc(u8 lyc);
 void lcd_reset_ly();
 
+void lcd_draw_line();
+
+// Takes the latest complete frame, which stays untouched until the next call
+u16 *lcd_present_fb();
+
 void lcd_c_write(u8 val);
 void lcd_vram_write(u16 adr, u8 val);
 
@@ -11,6 +11,7 @@
 #include "mbc.h"
 #include "util/card.h"
 #include "util/pathes.h"
+#include "instance.h"
 
 #define LOAD_BUFSIZE (1024)
 
@@ -56,33 +57,33 @@ static u16 rom_bankcount(u8 ref) {
 }
 
 static void init_mode(u8 ref) {
-    moo.mode = ref & 0x80 ? CGB_MODE : NON_CGB_MODE;
-    printf("%s\n", moo.mode == CGB_MODE ? "CGB mode" : "Non CGB Mode");
+    MOO.mode = ref & 0x80 ? CGB_MODE : NON_CGB_MODE;
+    printf("%s\n", MOO.mode == CGB_MODE ? "CGB mode" : "Non CGB Mode");
 }
 
 static void init_card(u8 ref) {
     u8 ln = ref & 0x0F;
     u8 hn = ref >> 4;
 
-    mbc.has_battery = 0;
-    mbc.has_ram = 0;
-    mbc.has_rtc = 0;
+    MBC.has_battery = 0;
+    MBC.has_ram = 0;
+    MBC.has_rtc = 0;
 
     if(hn == 0x0) {
         switch(ln) {
             case 0x0: case 0x8: case 0x9:
                 mbc_set_type(0);
-                mbc.has_battery = ln == 0x9;
-                mbc.has_ram = ln & 0x8;
+                MBC.has_battery = ln == 0x9;
+                MBC.has_ram = ln & 0x8;
             break;
             case 0x1: case 0x2: case 0x3:
                 mbc_set_type(1);
-                mbc.has_battery = ln == 0x3;
-                mbc.has_ram = ln & 0x2;
+                MBC.has_battery = ln == 0x3;
+                MBC.has_ram = ln & 0x2;
             break;
             case 0x5: case 0x6:
                 mbc_set_type(2);
-                mbc.has_battery = ln == 0x6;
+                MBC.has_battery = ln == 0x6;
             break;
             break;
             case 0xB: case 0xC: case 0xD:
@@ -90,8 +91,8 @@ static void init_card(u8 ref) {
             break;
             case 0xF:
                 mbc_set_type(3);
-                mbc.has_battery = 1;
-                mbc.has_rtc = 1;
+                MBC.has_battery = 1;
+                MBC.has_rtc = 1;
             break;
         }
     }
@@ -99,9 +100,9 @@ static void init_card(u8 ref) {
         switch(ln) {
             case 0x0: case 0x1: case 0x2:  case 0x3:
                 mbc_set_type(3);
-                mbc.has_battery = ln == 0 || ln == 3;
-                mbc.has_rtc = ln == 0;
-                mbc.has_ram = ln != 1;
+                MBC.has_battery = ln == 0 || ln == 3;
+                MBC.has_rtc = ln == 0;
+                MBC.has_ram = ln != 1;
             break;
             case 0x5: case 0x6: case 0x7:
                 mbc_set_type(4); // This is weird, as there is no such MBC...
@@ -109,8 +110,8 @@ static void init_card(u8 ref) {
             case 0x9: case 0xA: case 0xB: // Alas, no way to emulate rumbling... or maybe there is? Shake the screen a bit? :D
             case 0xC: case 0xD: case 0xE:
                 mbc_set_type(5);
-                mbc.has_battery = ln == 0xB || ln == 0xE;
-                mbc.has_ram = ln != 0x9 && ln != 0xC;
+                MBC.has_battery = ln == 0xB || ln == 0xE;
+                MBC.has_ram = ln != 0x9 && ln != 0xC;
             break;
             default:
                 moo_errorf("Unknown card-type #2");
@@ -123,35 +124,50 @@ static void init_card(u8 ref) {
     printf("Full cardridge type: %.2X\n", ref);
 }
 
+/*
+    A rejected ROM leaves no banks behind, neither NULL nor the previous
+    ROM's ones may be mapped then
+*/
 static void init_rom(u8 ref, u8 *rom, u32 romsize) {
-    card.romsize = rom_bankcount(ref);
-    if(card.romsize == 0) {
+    free(CARD.rombanks);
+    CARD.rombanks = NULL;
+
+    CARD.romsize = rom_bankcount(ref);
+    if(CARD.romsize == 0) {
         return;
     }
-    if(card.romsize * 0x4000 != romsize) {
+    if(CARD.romsize * 0x4000 != romsize) {
         moo_errorf("ROM doesn't fit into banks tightly...");
+        CARD.romsize = 0;
         return;
     }
-    if(romsize > sizeof(card.rombanks)) {
+    if(CARD.romsize > CARD_MAX_ROMBANKS) {
         moo_errorf("ROM (size = %i bytes) is too big for banks", romsize);
+        CARD.romsize = 0;
+        return;
+    }
+    CARD.rombanks = malloc(romsize);
+    if(CARD.rombanks == NULL) {
+        moo_errorf("Out of memory for a ROM of %i bytes", romsize);
+        CARD.romsize = 0;
         return;
     }
-    memcpy(card.rombanks, rom, romsize);
+    memcpy(CARD.rombanks, rom, romsize);
 
-    printf("ROM-size set to %d banks [%.2X]\n", card.romsize, ref);
+    printf("ROM-size set to %d banks [%.2X]\n", CARD.romsize, ref);
 }
 
 static void init_sram(u8 ref) {
     assert(ref <= 0x03);
 
-    card.sramsize = (u8[]){1, 1, 1, 4}[ref];
-    printf("Cardridge-RAM set to %d banks [%i]\n", card.sramsize, ref);
+    CARD.sramsize = (u8[]){1, 1, 1, 4}[ref];
+    printf("Cardridge-RAM set to %d banks [%i]\n", CARD.sramsize, ref);
 }
 
 void load_rom() {
     size_t romsize;
 
-    moo.state &= ~MOO_ROM_LOADED_BIT;
+    MOO.state &= ~MOO_ROM_LOADED_BIT;
 
     u8 *rom = load_binary(pathes.rom, &romsize);
     assert(romsize > 0x014F);
@@ -163,16 +179,17 @@ void load_rom() {
 
     card_load();
 
-    mbc.rombank = card.rombanks[1];
-    mbc.srambank = card.srambanks[0];
+    MBC.rombank = CARD.rombanks != NULL ? CARD.rombanks[1] : NULL;
+    MBC.srambank = CARD.srambanks[0];
+    mem_update_pages();
 
     free(rom);
 
-    if(~moo.state & MOO_ERROR_BIT) {
-        moo.state |= MOO_ROM_LOADED_BIT;
+    if(~MOO.state & MOO_ERROR_BIT) {
+        MOO.state |= MOO_ROM_LOADED_BIT;
     }
     else {
-        moo.state &= ~MOO_ROM_LOADED_BIT;
+        MOO.state &= ~MOO_ROM_LOADED_BIT;
     }
 }
 
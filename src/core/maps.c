@@ -6,76 +6,114 @@
 #include "mem.h"
 #include "moo.h"
 #include "lcd.h"
+#include "tile.h"
+#include "instance.h"
+
+/*
+    Composes a line straight from VRAM. Its tile data already is 2 bits per
+    pixel and stored per tile, so the working set is at most 16 KB of tile
+    data plus the maps, instead of 512 KB of caches. Palettes are applied
+    while composing the line. With PACKED_MAPS this is the only way lines
+    are drawn, otherwise it's used while palettes change between lines.
+*/
+static inline void compose_line(lcd_map_t *map, u8 mx, u8 my, int num, u16 *scan, pixel_meta_t *meta) {
+    u16 line_scan[21*8];
+    pixel_meta_t line_meta[21*8];
+    u8 index_offset = LCD.c & 0x10 ? 0x00 : 0x80;
+    u16 tdt_offset = LCD.c & 0x10 ? 0x0000 : 0x0800;
+    int tx = mx/8, ty = my/8;
+    int c;
+
+    for(c = 0; c*8 < mx%8 + num; c++) {
+        int x = (tx + c) % 32;
+        u8 attr = map->attr[ty*32 + x];
+        u8 tile = map->tiles[ty*32 + x] + index_offset;
+        u8 *linedata = &RAM.vrambanks[attr & 0x08 ? 1 : 0][tdt_offset + tile*0x10 + (attr & 0x40 ? 7 - my%8 : my%8)*2];
+        u64 row = attr & 0x20 ? tile_row_flipped(linedata) : tile_row(linedata);
 
-static u8 priority, palette, tile_index, attr, bank;
-static u8 *linedata;
+        tile_row_colors(row, LCD.bgp.map[attr & 0x07], &line_scan[c*8]);
+        tile_row_meta(row, attr & 0x80, &line_meta[c*8]);
+    }
 
-static inline u8 render(u8 rshift) {
-    u8 lsb = (linedata[0] >> rshift) & 0x01;
-    u8 msb = (linedata[1] >> rshift) & 0x01;
-    return (lsb | (msb << 1));
+    memcpy(scan, &line_scan[mx%8], num * sizeof(*scan));
+    memcpy(meta, &line_meta[mx%8], num * sizeof(*meta));
 }
 
-#define draw_tile_line(scan, meta, rshift_init, op) \
-    int tx; \
-    u8 rshift = rshift_init; \
-    \
-    for(tx = 0; tx < 8; tx++, rshift op) { \
-        (meta)[tx].color_id = render(rshift); \
-        (meta)[tx].priority = priority; \
-        (scan)[tx] = lcd.bgp.map[palette][(meta)[tx].color_id]; \
-    }
+#ifndef PACKED_MAPS
 
-#define iterate_tile(line_init, op) \
-    u8 line = line_init; \
-    for(ty = 0; ty < 8; ty++, line op, cy++) { \
-        linedata = &tdt[tile*0x10 + line*2]; \
-        \
-        if(attr & 0x20) { \
-            draw_tile_line(&map->scan_cache[cy][cx], &map->cache_meta[cy][cx], 0, ++); \
-        } \
-        else { \
-            draw_tile_line(&map->scan_cache[cy][cx], &map->cache_meta[cy][cx], 7, --); \
-        } \
-    }
+static __thread u8 palette, tile_index, attr, bank;
 
 static inline void draw_tile(lcd_map_t *map, int tx, int ty) {
-    u8 index_offset = lcd.c & 0x10 ? 0x00 : 0x80;
+    u8 index_offset = LCD.c & 0x10 ? 0x00 : 0x80;
     u8 tile = tile_index + index_offset;
 
-    priority = attr & 0x80;
-    u8 *tdt = &ram.vrambanks[bank][lcd.c & 0x10 ? 0x0000 : 0x0800];
+    u8 priority = attr & 0x80;
+    u8 *tdt = &RAM.vrambanks[bank][LCD.c & 0x10 ? 0x0000 : 0x0800];
 
     u8 cx = tx*8;
     u8 cy = ty*8;
+    int line;
+
+    for(line = 0; line < 8; line++, cy++) {
+        u8 *linedata = &tdt[tile*0x10 + (attr & 0x40 ? 7 - line : line)*2];
+        u64 row = attr & 0x20 ? tile_row_flipped(linedata) : tile_row(linedata);
 
-    if(attr & 0x40) {
-        iterate_tile(7, --);
+        tile_row_colors(row, LCD.bgp.map[palette], &map->scan_cache[cy][cx]);
+        tile_row_meta(row, priority, &map->cache_meta[cy][cx]);
     }
-    else {
-        iterate_tile(0, ++);
+}
+
+/*
+    The cells of both maps (cell = map*1024 + tile) referencing the same
+    bank and tile index are kept in a list, so changed tile data only
+    invalidates the cells actually showing it
+*/
+#define NO_REF 0xFFFF
+
+static inline u16 cell_key(int cell) {
+    lcd_map_t *map = &LCD.maps[cell / 1024];
+    return (map->attr[cell % 1024] & 0x08 ? 0x100 : 0x000) | map->tiles[cell % 1024];
+}
+
+static void link_ref(int cell) {
+    map_ref_t *ref = &LCD.map_refs[cell];
+    u16 *head;
+
+    ref->key = cell_key(cell);
+    head = &LCD.index_refs[ref->key];
+
+    ref->prev = NO_REF;
+    ref->next = *head;
+    if(*head != NO_REF) {
+        LCD.map_refs[*head].prev = cell;
     }
+    *head = cell;
 }
 
-static inline void mark_index_refs_dirty_on_map(lcd_map_t *map, int x, int y, u8 index) {
-    if(map->tiles[y*32 + x] == index) {
-       map->tile_dirty[y][x] = 1;
+static void unlink_ref(int cell) {
+    map_ref_t *ref = &LCD.map_refs[cell];
+
+    if(ref->prev != NO_REF) {
+        LCD.map_refs[ref->prev].next = ref->next;
+    }
+    else {
+        LCD.index_refs[ref->key] = ref->next;
+    }
+    if(ref->next != NO_REF) {
+        LCD.map_refs[ref->next].prev = ref->prev;
     }
 }
 
-static inline void mark_index_refs_dirty(u8 index) {
-    int x, y;
+static inline void mark_index_refs_dirty(u8 bank, u8 index) {
+    u16 cell;
 
-    for(y = 0; y < 32; y++) {
-        for(x = 0; x < 32; x++) {
-            mark_index_refs_dirty_on_map(&lcd.maps[0], x, y, index);
-            mark_index_refs_dirty_on_map(&lcd.maps[1], x, y, index);
-        }
+    for(cell = LCD.index_refs[bank << 8 | index]; cell != NO_REF; cell = LCD.map_refs[cell].next) {
+        LCD.maps[cell / 1024].tile_dirty[(cell % 1024) / 32][cell % 32] = 1;
     }
 }
 
-#define cached_dirty(dword) map->cached_palette[ty][x][dword] != *(u32*)&lcd.bgp.d[palette*8 + dword*4]
-#define cache_palette(dword) map->cached_palette[ty][x][dword] = *(u32*)&lcd.bgp.d[palette*8 + dword*4]
+#define cached_dirty(dword) map->cached_palette[ty][x][dword] != *(u32*)&LCD.bgp.d[palette*8 + dword*4]
+#define cache_palette(dword) map->cached_palette[ty][x][dword] = *(u32*)&LCD.bgp.d[palette*8 + dword*4]
 
 static inline void redraw_dirty(lcd_map_t *map, int tx, int ty) {
     int c;
@@ -88,9 +126,9 @@ static inline void redraw_dirty(lcd_map_t *map, int tx, int ty) {
         palette = attr & 0x07;
         tile_index = map->tiles[ty*32 + x];
 
-        if(lcd.index_dirty[bank][tile_index]) {
-            mark_index_refs_dirty(tile_index);
-            lcd.index_dirty[bank][tile_index] = 0;
+        if(LCD.index_dirty[bank][tile_index]) {
+            mark_index_refs_dirty(bank, tile_index);
+            LCD.index_dirty[bank][tile_index] = 0;
         }
 
         if(cached_dirty(0) || cached_dirty(1)) {
@@ -106,68 +144,154 @@ static inline void redraw_dirty(lcd_map_t *map, int tx, int ty) {
     }
 }
 
-static inline void scan_bg(u16 *scan, pixel_meta_t *meta) {
-    lcd_map_t *map =  &lcd.maps[lcd.c & 0x08 ? 1 : 0];
+// Copies num pixels of a line from the cache, wrapping around its right edge
+static inline void cached_line(lcd_map_t *map, u8 mx, u8 my, int num, u16 *scan, pixel_meta_t *meta) {
+    int ex = min(256 - mx, num);
+
+    redraw_dirty(map, mx/8, my/8);
+
+    memcpy(scan, &map->scan_cache[my][mx], ex * sizeof(*scan));
+    memcpy(meta, &map->cache_meta[my][mx], ex * sizeof(*meta));
+    memcpy(&scan[ex], &map->scan_cache[my][0], (num - ex) * sizeof(*scan));
+    memcpy(&meta[ex], &map->cache_meta[my][0], (num - ex) * sizeof(*meta));
+}
+
+/*
+    ROMs changing the palettes between lines make the cached tiles useless,
+    they'd be redrawn on nearly every line. Once a frame had CHURN_LINES
+    lines with new palettes, lines are composed directly until the palettes
+    stayed put for STABLE_FRAMES frames
+*/
+#define CHURN_LINES 16
+#define STABLE_FRAMES 60
+
+static inline void detect_palette_churn() {
+    if(LCD.ly == 0) {
+        if(LCD.palette_lines >= CHURN_LINES) {
+            LCD.direct_maps = 1;
+            LCD.stable_frames = 0;
+        }
+        else if(LCD.direct_maps && ++LCD.stable_frames >= STABLE_FRAMES) {
+            LCD.direct_maps = 0;
+            maps_dirty();
+        }
+        LCD.palette_lines = 0;
+    }
+
+    if(LCD.palette_changed) {
+        LCD.palette_lines++;
+        LCD.palette_changed = 0;
+    }
+}
 
-    int my = (lcd.ly + lcd.scy) % 256;
-    int ex = min(256 - lcd.scx, 160);
+#endif
+
+static inline void map_line(lcd_map_t *map, u8 mx, u8 my, int num, u16 *scan, pixel_meta_t *meta) {
+#ifdef PACKED_MAPS
+    compose_line(map, mx, my, num, scan, meta);
+#else
+    if(LCD.direct_maps) {
+        compose_line(map, mx, my, num, scan, meta);
+    }
+    else {
+        cached_line(map, mx, my, num, scan, meta);
+    }
+#endif
+}
 
-    redraw_dirty(map, lcd.scx/8, my/8);
+static inline void scan_bg(u16 *scan, pixel_meta_t *meta) {
+    lcd_map_t *map =  &LCD.maps[LCD.c & 0x08 ? 1 : 0];
 
-    memcpy(scan, &map->scan_cache[my][lcd.scx], ex * sizeof(*scan));
-    memcpy(meta, &map->cache_meta[my][lcd.scx], ex * sizeof(*meta));
-    memcpy(&scan[ex], &map->scan_cache[my][0], (160 - ex) * sizeof(*scan));
-    memcpy(&meta[ex], &map->cache_meta[my][0], (160 - ex) * sizeof(*meta));
+    map_line(map, LCD.scx, LCD.ly + LCD.scy, 160, scan, meta);
 }
 
 
 static inline void scan_wnd(u16 *scan, pixel_meta_t *meta) {
-    if(lcd.wy > lcd.ly || lcd.wx > 166) {
+    if(LCD.wy > LCD.ly || LCD.wx > 166) {
         return;
     }
-    lcd_map_t *map =  &lcd.maps[lcd.c & 0x40 ? 1 :0];
+    lcd_map_t *map =  &LCD.maps[LCD.c & 0x40 ? 1 :0];
 
-    u8 mx = -min(lcd.wx - 7, 0);
-    u8 my = lcd.ly - lcd.wy;
-    u8 sx = max(lcd.wx - 7, 0);
+    u8 mx = -min(LCD.wx - 7, 0);
+    u8 my = LCD.ly - LCD.wy;
+    u8 sx = max(LCD.wx - 7, 0);
 
-    redraw_dirty(map, mx/8, my/8);
-
-    memcpy(&scan[sx], &map->scan_cache[my][mx], (160 - sx) * sizeof(*scan));
-    memcpy(&meta[sx], &map->cache_meta[my][mx], (160 - sx) * sizeof(*meta));
+    map_line(map, mx, my, 160 - sx, &scan[sx], &meta[sx]);
 }
 
 void lcd_scan_maps(u16 *scan, pixel_meta_t *meta) {
+#ifndef PACKED_MAPS
+    detect_palette_churn();
+#endif
+
     scan_bg(scan, meta);
 
-    if(lcd.c & 0x20) {
+    if(LCD.c & 0x20) {
         scan_wnd(scan, meta);
     }
 }
 
+#ifdef PACKED_MAPS
+
+// There are no caches to invalidate
+void maps_tiledata_dirty(int absolute_index) {}
+void maps_tile_dirty(lcd_map_t *map, int tile) {}
+void maps_dirty() {}
+void maps_rebuild_refs() {}
+void maps_palette_changed() {}
+
+#else
+
 void maps_tiledata_dirty(int absolute_index) {
     u8 tile;
-    if(lcd.c & 0x10) {
+    if(LCD.c & 0x10) {
         if(absolute_index > 255) {
             return;
         }
         tile = absolute_index;
     }
     else {
-        if(absolute_index <= 128) {
+        if(absolute_index < 128) {
             return;
         }
         tile = absolute_index - 256;
     }
-    lcd.index_dirty[ram.selected_vrambank][tile] = 1;
+    LCD.index_dirty[RAM.selected_vrambank][tile] = 1;
 }
 
 void maps_tile_dirty(lcd_map_t *map, int tile) {
+    int cell = (map - LCD.maps) * 1024 + tile;
+
     map->tile_dirty[tile/32][tile%32] = 1;
+
+    if(LCD.map_refs[cell].key != cell_key(cell)) {
+        unlink_ref(cell);
+        link_ref(cell);
+    }
 }
 
 void maps_dirty() {
-    memset(lcd.maps[0].tile_dirty, 0xFF, sizeof(lcd.maps[0].tile_dirty));
-    memset(lcd.maps[1].tile_dirty, 0xFF, sizeof(lcd.maps[1].tile_dirty));
+    memset(LCD.maps[0].tile_dirty, 0xFF, sizeof(LCD.maps[0].tile_dirty));
+    memset(LCD.maps[1].tile_dirty, 0xFF, sizeof(LCD.maps[1].tile_dirty));
+}
+
+void maps_palette_changed() {
+    LCD.palette_changed = 1;
+
+    // DMG palettes aren't compared per tile
+    if(MOO.mode == NON_CGB_MODE && !LCD.direct_maps) {
+        maps_dirty();
+    }
+}
+
+void maps_rebuild_refs() {
+    int cell;
+
+    memset(LCD.index_refs, 0xFF, sizeof(LCD.index_refs));
+
+    for(cell = 2047; cell >= 0; cell--) {
+        link_ref(cell);
+    }
 }
 
+#endif
@@ -8,5 +8,7 @@
     void maps_tiledata_dirty(int tileindex);
     void maps_tile_dirty(lcd_map_t *map, int tile);
     void maps_dirty();
+    void maps_rebuild_refs();
+    void maps_palette_changed();
 
 #endif
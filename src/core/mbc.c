@@ -5,15 +5,15 @@
 #include "rtc.h"
 #include "moo.h"
 #include "mem.h"
+#include "instance.h"
 
 #define MBC3_MAP_RAM 0x00
 #define MBC3_MAP_RTC 0x01
 
-mbc_t mbc;
-mbc1_t mbc1;
-mbc3_t mbc3;
-mbc5_t mbc5;
 
+u8 *mbc_rombank(unsigned int bank) {
+    return CARD.rombanks[bank % CARD.romsize];
+}
 
 static void mbc0_lower_write(u16 adr, u8 val) {
     // Nothing to do here
@@ -22,31 +22,31 @@ static void mbc0_lower_write(u16 adr, u8 val) {
 static void mbc1_lower_write(u16 adr, u8 val) {
     switch(adr >> 12) {
         case 0x0: case 0x1: // Enable/Disable external RAM
-            mbc.ram_selected = (val & 0x0F) == 0x0A;
+            MBC.ram_selected = (val & 0x0F) == 0x0A;
         break;
         case 0x2: case 0x3: // Select lower ROM bank bits
-            mbc1.rombank &= 0xE0;
-            mbc1.rombank |= (val & 0x1F) == 0x00 ? 0x01 : (val & 0x1F);
-            if(mbc1.rombank >= card.romsize) {
-                mbc1.rombank = 1;
+            MBC1.rombank &= 0xE0;
+            MBC1.rombank |= (val & 0x1F) == 0x00 ? 0x01 : (val & 0x1F);
+            if(MBC1.rombank >= CARD.romsize) {
+                MBC1.rombank = 1;
             }
-            mbc.rombank = card.rombanks[mbc1.rombank];
+            MBC.rombank = mbc_rombank(MBC1.rombank);
         break;
         case 0x4: case 0x5:
-            if(mbc1.mode == 0) { // Upper ROM bank bits
-                mbc1.rombank &= 0x1F;
-                mbc1.rombank |= (val & 0x03) << 5;
-                if(mbc1.rombank >= card.romsize) {
-                    mbc1.rombank = 1;
+            if(MBC1.mode == 0) { // Upper ROM bank bits
+                MBC1.rombank &= 0x1F;
+                MBC1.rombank |= (val & 0x03) << 5;
+                if(MBC1.rombank >= CARD.romsize) {
+                    MBC1.rombank = 1;
                 }
-                mbc.rombank = card.rombanks[mbc1.rombank];
+                MBC.rombank = mbc_rombank(MBC1.rombank);
             }
             else { // Cartridge RAM bits
-                mbc.srambank = card.srambanks[val & 0x03];
+                MBC.srambank = CARD.srambanks[val & 0x03];
             }
         break;
         case 0x6: case 0x7: // RAM or ROM banking mode
-            mbc1.mode = val & 0x01;
+            MBC1.mode = val & 0x01;
         break;
         default:
             assert(0);
@@ -56,11 +56,11 @@ static void mbc1_lower_write(u16 adr, u8 val) {
 static void mbc2_lower_write(u16 adr, u8 val) {
     switch(adr >> 12) {
         case 0: case 1: // RAM en/disable
-            mbc.ram_selected = (adr & 0x0100) == 0x0000;
+            MBC.ram_selected = (adr & 0x0100) == 0x0000;
         break;
         case 2: case 3:
             if(adr & 0x10) { // Least significant bit of upper address byte has to be zero.
-                mbc.rombank = card.rombanks[val & 0x0F];
+                MBC.rombank = mbc_rombank(val & 0x0F);
             }
         break;
         default:
@@ -71,20 +71,20 @@ static void mbc2_lower_write(u16 adr, u8 val) {
 static void mbc3_lower_write(u16 adr, u8 val) {
     switch(adr >> 12) {
         case 0: case 1: // RAM and RTC en/disable
-            mbc.ram_selected = (val & 0x0F) == 0x0A;
+            MBC.ram_selected = (val & 0x0F) == 0x0A;
         break;
         case 2: case 3: // Select ROM bank
-            mbc.rombank = card.rombanks[(val & 0x7F) == 0x00 ? 0x01 : (val & 0x7F)];
+            MBC.rombank = mbc_rombank((val & 0x7F) == 0x00 ? 0x01 : (val & 0x7F));
         break;
         case 4: case 5: // Select RAM bank or RTC register
             switch(val & 0x0F) {
                 case 0x00: case 0x01: case 0x02: case 0x03:
-                    mbc.srambank = card.srambanks[val & 0x03];
-                    mbc3.mode = MBC3_MAP_RAM;
+                    MBC.srambank = CARD.srambanks[val & 0x03];
+                    MBC3.mode = MBC3_MAP_RAM;
                 break;
                 case 0x08: case 0x09: case 0x0A: case 0x0B: case 0x0C:
                     rtc_map_register(val & 0x0F);
-                    mbc3.mode = MBC3_MAP_RTC;
+                    MBC3.mode = MBC3_MAP_RTC;
                 break;
                 default:;
 #ifdef DEBUG
@@ -103,93 +103,98 @@ static void mbc3_lower_write(u16 adr, u8 val) {
 static void mbc5_lower_write(u16 adr, u8 val) {
     switch(adr >> 12) {
         case 0: case 1: // En/disable RAM
-            mbc.ram_selected = (val & 0x0F) == 0x0A;
+            MBC.ram_selected = (val & 0x0F) == 0x0A;
         break;
         case 2:  // Select lower 8 bit of ROM bank
-            mbc5.rombank &= 0xFF00;
-            mbc5.rombank |= val;
-
-            if(mbc5.rombank >= card.romsize) {
-                moo_errorf("Illegal request of ROM-bank %i, card only provides %i", mbc5.rombank, card.romsize);
-            }
+            MBC5.rombank &= 0xFF00;
+            MBC5.rombank |= val;
 
-            mbc.rombank = card.rombanks[mbc5.rombank];
+            MBC.rombank = mbc_rombank(MBC5.rombank);
         break;
         case 3: // Select upper 1 bit of ROM bank
         break;
-            mbc5.rombank &= 0xFEFF;
-            mbc5.rombank |= ((u16)val&0x01)<<8;
+            MBC5.rombank &= 0xFEFF;
+            MBC5.rombank |= ((u16)val&0x01)<<8;
 
-            if(mbc5.rombank >= card.romsize) {
-                moo_errorf("Illegal request of ROM-bank %i, card only provides %i", mbc5.rombank, card.romsize);
-            }
-
-            mbc.rombank = card.rombanks[mbc5.rombank];
+            MBC.rombank = mbc_rombank(MBC5.rombank);
         break;
         case 4: case 5:
-            if((val&0x0F) >= card.sramsize) {
+            if((val&0x0F) >= CARD.sramsize) {
                 return;
             }
-            mbc.srambank = card.srambanks[val & 0x01];
+            MBC.srambank = CARD.srambanks[val & 0x01];
         break;
         default:;
 #ifdef DEBUG
             printf("Suspicious write %.2X to %.4X\n", val, adr);
 #endif
     }
-    assert(mbc5.rombank < 0x1E0);
+    assert(MBC5.rombank < 0x1E0);
 }
 
 void mbc_set_type(u8 type) {
-    mbc.type = type;
+    MBC.type = type;
 
     switch(type) {
-        case 0: mbc.lower_write_func = mbc0_lower_write; break;
-        case 1: mbc.lower_write_func = mbc1_lower_write; break;
-        case 2: mbc.lower_write_func = mbc2_lower_write; break;
-        case 3: mbc.lower_write_func = mbc3_lower_write; break;
-        case 5: mbc.lower_write_func = mbc5_lower_write; break;
+        case 0: MBC.lower_write_func = mbc0_lower_write; break;
+        case 1: MBC.lower_write_func = mbc1_lower_write; break;
+        case 2: MBC.lower_write_func = mbc2_lower_write; break;
+        case 3: MBC.lower_write_func = mbc3_lower_write; break;
+        case 5: MBC.lower_write_func = mbc5_lower_write; break;
         default:
             moo_errorf("No such MBC-type %i", type);
     }
     printf("MBC-type is %i\n", (int)type);
+
+    mem_update_pages();
+}
+
+int mbc_sram_mapped() {
+#ifdef DEBUG
+    if(!MBC.ram_selected) {
+        return 0;
+    }
+#endif
+
+    return !(MBC.type == 3 && MBC3.mode == MBC3_MAP_RTC);
 }
 
 u8 mbc_upper_read(u16 adr) {
 #ifdef DEBUG
-    if(!mbc.ram_selected) {
+    if(!MBC.ram_selected) {
         printf("Denied RAM access!\n");
         return 0x00;
     }
 #endif
 
-    if(mbc.type == 3 && mbc3.mode == MBC3_MAP_RTC) {
-        return rtc.latched[rtc.mapped];
+    if(MBC.type == 3 && MBC3.mode == MBC3_MAP_RTC) {
+        return RTC.latched[RTC.mapped];
     }
     else {
          adr -= 0xA000;
-         return mbc.srambank[adr];
+         return MBC.srambank[adr];
     }
 }
 
 void mbc_lower_write(u16 adr, u8 val) {
-    mbc.lower_write_func(adr, val);
+    MBC.lower_write_func(adr, val);
+    mem_update_pages();
 }
 
 void mbc_upper_write(u16 adr, u8 val) {
 #ifdef DEBUG
-    if(!mbc.ram_selected) {
+    if(!MBC.ram_selected) {
         printf("Denied RAM access!\n");
         return;
     }
 #endif
 
-    if(mbc.type == 3 && mbc3.mode == MBC3_MAP_RTC) {
+    if(MBC.type == 3 && MBC3.mode == MBC3_MAP_RTC) {
         rtc_write(val);
     }
     else {
         adr -= 0xA000;
-        mbc.srambank[adr] = val;
+        MBC.srambank[adr] = val;
     }
 }
 
@@ -32,13 +32,14 @@ typedef struct {
     u16 rombank;
 } mbc5_t;
 
-extern mbc_t mbc;
-extern mbc1_t mbc1;
-extern mbc3_t mbc3;
-extern mbc5_t mbc5;
 
 void mbc_set_type(u8 type);
 
+// Banks beyond the card's size wrap around, like the unconnected address lines do
+u8 *mbc_rombank(unsigned int bank);
+
+int mbc_sram_mapped();
+
 u8 mbc_upper_read(u16 adr);
 void mbc_lower_write(u16 adr, u8 val);
 void mbc_upper_write(u16 adr, u8 val);
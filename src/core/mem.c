@@ -5,15 +5,16 @@
 #include <string.h>
 #include "io.h"
 #include "lcd.h"
+#include "obj.h"
+#include "render.h"
 #include "cpu.h"
 #include "mbc.h"
 
+#include "instance.h"
 #ifdef DEBUG
 #include "debug/watch.h"
 #endif // DEBUG
 
-ram_t ram;
-card_t card;
 
 static u8 read_locked_mem(u16 adr) {
 #ifdef DEBUG
@@ -29,21 +30,75 @@ static void write_locked_mem(u16 adr, u8 val) {
 }
 
 void mem_reset() {
-    memset(ram.rambanks, 0x00, sizeof(ram.rambanks));
-    memset(ram.hram, 0x00, sizeof(ram.hram));
-    memset(ram.vrambanks, 0x00, sizeof(ram.vrambanks));
-    memset(ram.oam, 0x00, sizeof(ram.oam));
+    memset(RAM.rambanks, 0x00, sizeof(RAM.rambanks));
+    memset(RAM.hram, 0x00, sizeof(RAM.hram));
+    memset(RAM.vrambanks, 0x00, sizeof(RAM.vrambanks));
+    memset(RAM.oam, 0x00, sizeof(RAM.oam));
 
-    ram.rambank = ram.rambanks[1];
+    RAM.rambank = RAM.rambanks[1];
 
-    mbc.ram_selected = 1;
+    MBC.ram_selected = 1;
 
-    ram.rambank_index = 1;
-    ram.selected_vrambank = 0;
+    RAM.rambank_index = 1;
+    RAM.selected_vrambank = 0;
+
+    mem_update_pages();
+}
+
+/*
+    VRAM is only locked in mode 3 with the LCD on, so the LCD's mode events
+    just refresh these two pages instead of all of them
+*/
+void mem_update_vram_pages() {
+    int vram_locked = (LCD.stat & 0x03) == 0x03 && (LCD.c & 0x80);
+    int p;
+
+    for(p = 0x8; p < 0xA; p++) {
+        RAM.read_pages[p] = vram_locked ? NULL : &RAM.vrambanks[RAM.selected_vrambank][(p - 0x8) << 12];
+        RAM.write_pages[p] = NULL; // Tile and map caches need to know
+    }
+}
+
+/*
+    Has to be called whenever a bank or the MBC mode changes
+*/
+void mem_update_pages() {
+    int sram_mapped = MBC.srambank != NULL && mbc_sram_mapped();
+    int wram_writable = MBC.type != 2;
+    int p;
+
+    for(p = 0x0; p < 0x4; p++) {
+        RAM.read_pages[p] = CARD.rombanks != NULL ? &CARD.rombanks[0][p << 12] : NULL;
+        RAM.write_pages[p] = NULL;
+    }
+    for(p = 0x4; p < 0x8; p++) {
+        RAM.read_pages[p] = MBC.rombank != NULL ? &MBC.rombank[(p - 0x4) << 12] : NULL;
+        RAM.write_pages[p] = NULL;
+    }
+    mem_update_vram_pages();
+    for(p = 0xA; p < 0xC; p++) {
+        RAM.read_pages[p] = sram_mapped ? &MBC.srambank[(p - 0xA) << 12] : NULL;
+        RAM.write_pages[p] = RAM.read_pages[p];
+    }
+
+    RAM.read_pages[0xC] = RAM.rambanks[0];
+    RAM.read_pages[0xD] = RAM.rambank;
+    RAM.read_pages[0xE] = RAM.rambanks[0];
+    RAM.read_pages[0xF] = NULL;
+
+    for(p = 0xC; p < 0xF; p++) {
+        RAM.write_pages[p] = wram_writable ? RAM.read_pages[p] : NULL;
+    }
+    RAM.write_pages[0xF] = NULL;
 }
 
 u8 mem_read_byte(u16 adr) {
-#ifdef DEBUG
+#ifndef DEBUG
+    u8 *page = RAM.read_pages[adr >> 12];
+    if(page != NULL) {
+        return page[adr & 0x0FFF];
+    }
+#else
     {
         static int recurse = 1;
 
@@ -59,25 +114,25 @@ u8 mem_read_byte(u16 adr) {
 
     switch(adr >> 12) {
         case 0x0: case 0x1: case 0x2: case 0x3:
-            return card.rombanks[0][adr];
+            return CARD.rombanks[0][adr];
         break;
         case 0x4: case 0x5: case 0x6: case 0x7:
-            return mbc.rombank[adr - 0x4000];
+            return MBC.rombank[adr - 0x4000];
         break;
         case 0x8: case 0x9:
-            if((lcd.stat & 0x03) == 0x03 && (lcd.c & 0x80))
+            if((LCD.stat & 0x03) == 0x03 && (LCD.c & 0x80))
                 return read_locked_mem(adr);
             else
-                return ram.vrambanks[ram.selected_vrambank][adr - 0x8000];
+                return RAM.vrambanks[RAM.selected_vrambank][adr - 0x8000];
         break;
         case 0xA: case 0xB:
             return mbc_upper_read(adr);
         break;
         case 0xC:
-            return ram.rambanks[0][adr - 0xC000];
+            return RAM.rambanks[0][adr - 0xC000];
         break;
         case 0xD:
-            return ram.rambank[adr - 0xD000];
+            return RAM.rambank[adr - 0xD000];
         break;
         case 0xE:
             return mem_read_byte(adr - 0x2000);
@@ -87,10 +142,10 @@ u8 mem_read_byte(u16 adr) {
                 return mem_read_byte(adr - 0x2000);
             }
             else if(adr >= 0xFE00 && adr < 0xFEA0) { // Sprite attributes
-                if((lcd.stat & 0x03) > 0x01 && (lcd.c & 0x80))
+                if((LCD.stat & 0x03) > 0x01 && (LCD.c & 0x80))
                     return read_locked_mem(adr);
                 else
-                    return ram.oam[adr - 0xFE00];
+                    return RAM.oam[adr - 0xFE00];
             }
             else if(adr >= 0xFEA0 && adr < 0xFF00) { // Locked
                 return read_locked_mem(adr);
@@ -99,10 +154,10 @@ u8 mem_read_byte(u16 adr) {
                 return io_read(adr);
             }
             else if(adr >= 0xFF80 && adr < 0xFFFF) { // HiRAM
-                return ram.hram[adr - 0xFF80];
+                return RAM.hram[adr - 0xFF80];
             }
             else {
-                return cpu.ie;
+                return CPU.ie;
             }
         break;
     }
@@ -116,7 +171,13 @@ u16 mem_read_word(u16 adr) {
 }
 
 void mem_write_byte(u16 adr, u8 val) {
-#ifdef DEBUG
+#ifndef DEBUG
+    u8 *page = RAM.write_pages[adr >> 12];
+    if(page != NULL) {
+        page[adr & 0x0FFF] = val;
+        return;
+    }
+#else
     u8 watch_old_val = mem_read_byte(adr);
 #endif // DEBUG
 
@@ -126,7 +187,7 @@ void mem_write_byte(u16 adr, u8 val) {
             mbc_lower_write(adr, val);
         break;
         case 0x8: case 0x9:
-            if((lcd.stat & 0x03) != 0x03 || !(lcd.c & 0x80)) {
+            if((LCD.stat & 0x03) != 0x03 || !(LCD.c & 0x80)) {
                 lcd_vram_write(adr, val);
             }
             else {
@@ -137,10 +198,10 @@ void mem_write_byte(u16 adr, u8 val) {
             mbc_upper_write(adr, val);
         break;
         case 0xC:
-            ram.rambanks[0][adr - 0xC000] = (mbc.type == 2) ? (val & 0x0F) : val;
+            RAM.rambanks[0][adr - 0xC000] = (MBC.type == 2) ? (val & 0x0F) : val;
         break;
         case 0xD:
-            ram.rambank[adr - 0xD000] = (mbc.type == 2) ? (val & 0x0F) : val;
+            RAM.rambank[adr - 0xD000] = (MBC.type == 2) ? (val & 0x0F) : val;
         break;
         case 0xE:
             mem_write_byte(adr - 0x2000, val);
@@ -151,8 +212,15 @@ void mem_write_byte(u16 adr, u8 val) {
                 mem_write_byte(adr - 0x2000, val);
             }
             else if(adr >= 0xFE00 && adr < 0xFEA0) { // Sprite attributes
-                if((lcd.stat & 0x03) <= 0x01 || !(lcd.c & 0x80))
-                    ram.oam[adr - 0xFE00] = val;
+                if((LCD.stat & 0x03) <= 0x01 || !(LCD.c & 0x80)) {
+                    RAM.oam[adr - 0xFE00] = val;
+                    obj_dirty();
+#ifdef RENDER_THREAD
+                    if(RENDERER != NULL) {
+                        render_oam_write(adr - 0xFE00, val);
+                    }
+#endif
+                }
                 else
                     write_locked_mem(adr, val);
             }
@@ -163,10 +231,10 @@ void mem_write_byte(u16 adr, u8 val) {
                 io_write(adr, val);
             }
             else if(adr >= 0xFF80 && adr < 0xFFFF) { // HiRAM
-                ram.hram[adr - 0xFF80] = val;
+                RAM.hram[adr - 0xFF80] = val;
             }
             else {
-                cpu.ie = val & 0x1F;
+                CPU.ie = val & 0x1F;
             }
         break;
         default:
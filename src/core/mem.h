@@ -13,20 +13,25 @@ typedef struct {
 
     u8 rambank_index;
     u8 selected_vrambank;
+
+    // Direct pointers to the 4KB pages, NULL where a handler is needed
+    u8 *read_pages[16];
+    u8 *write_pages[16];
 } ram_t;
 
+#define CARD_MAX_ROMBANKS 256
+
 typedef struct {
     u8 srambanks[4][0x2000];
-    u8 rombanks[256][0x4000];
+    u8 (*rombanks)[0x4000]; // Sized to the loaded ROM
     u16 romsize;
     u16 sramsize;
 } card_t;
 
 
-extern ram_t ram;
-extern card_t card;
-
 void mem_reset();
+void mem_update_pages();
+void mem_update_vram_pages(); // Only VRAM, e.g. when the LCD locks or unlocks it
 
 u8 mem_read_byte(u16 adr);
 u16 mem_read_word(u16 adr);
@@ -16,6 +16,8 @@
 #include "joy.h"
 #include "ints.h"
 #include "mbc.h"
+#include "ops.h"
+#include "render.h"
 #include "load.h"
 #include "serial.h"
 #include "sys/sys.h"
@@ -29,12 +31,11 @@
 #include "util/speed.h"
 #include "sound.h"
 
+#include "instance.h"
 #ifdef DEBUG
 #include "debug/debug.h"
 #endif
 
-moo_t moo;
-
 
 static void on_rom_over() {
     state_save(pathes.continue_state);
@@ -62,8 +63,12 @@ void moo_close() {
     //serial_close();
 }
 
+/*
+    Only resets the selected instance, so it's safe on a worker thread,
+    e.g. through moo_errorf(). State of the host shared by all instances
+    is reset by the frontend paths through reset_host()
+*/
 void moo_reset() {
-    sys_reset();
     mem_reset();
     hw_reset();
     cpu_reset();
@@ -73,18 +78,22 @@ void moo_reset() {
     sound_reset();
     joy_reset();
     //serial_reset();
+}
 
+static void reset_host() {
+    sys_reset();
     performance_reset();
     framerate_reset();
     speed_reset();
 }
 
 void moo_begin() {
-    moo.state |= MOO_ROM_RUNNING_BIT;
+    MOO.state |= MOO_ROM_RUNNING_BIT;
 
     rtc_begin();
     sound_begin();
     lcd_begin();
+    render_resync();
     timers_begin();
     sys_begin();
     framerate_begin();
@@ -92,14 +101,15 @@ void moo_begin() {
 }
 
 void moo_continue() {
-    if((moo.state & MOO_ROM_LOADED_BIT) && (~moo.state & MOO_ERROR_BIT)) {
-        moo.state |= MOO_ROM_RUNNING_BIT;
+    if((MOO.state & MOO_ROM_LOADED_BIT) && (~MOO.state & MOO_ERROR_BIT)) {
+        MOO.state |= MOO_ROM_RUNNING_BIT;
         sys_continue();
     }
 }
 
 void moo_restart_rom() {
     card_save();
+    reset_host();
     moo_reset();
     moo_load_rom_config();
     card_load();
@@ -107,14 +117,14 @@ void moo_restart_rom() {
 }
 
 void moo_pause() {
-    moo.state ^= MOO_ROM_RUNNING_BIT;
+    MOO.state ^= MOO_ROM_RUNNING_BIT;
     sys_pause();
 }
 
 void moo_quit() {
-    moo.state &= ~MOO_RUNNING_BIT;
+    MOO.state &= ~MOO_RUNNING_BIT;
 
-    if(moo.state & MOO_ROM_LOADED_BIT) {
+    if(MOO.state & MOO_ROM_LOADED_BIT) {
         on_rom_over();
     }
 }
@@ -133,7 +143,7 @@ static void warn_rtc_sav_conflict() {
 }
 
 void moo_load_rom(const char *path) {
-    if(moo.state & MOO_ROM_LOADED_BIT) {
+    if(MOO.state & MOO_ROM_LOADED_BIT) {
         on_rom_over();
     }
     if(path != pathes.rom) {
@@ -142,11 +152,12 @@ void moo_load_rom(const char *path) {
 
     printf("Loading ROM '%s'\n", pathes.rom);
 
+    reset_host();
     moo_reset();
     moo_load_rom_config();
     load_rom();
 
-    if(~moo.state & MOO_ROM_LOADED_BIT) {
+    if(~MOO.state & MOO_ROM_LOADED_BIT) {
         printf("Failed to load ROM\n");
         return;
     }
@@ -154,7 +165,7 @@ void moo_load_rom(const char *path) {
     store_rompath();
     moo_begin();
 
-    if(mbc.has_rtc && !sys.warned_rtc_sav_conflict) {
+    if(MBC.has_rtc && !sys.warned_rtc_sav_conflict) {
         moo_paused_do(warn_rtc_sav_conflict);
     }
 
@@ -179,40 +190,91 @@ void moo_load_rom_config() {
 }
 
 void moo_set_hw(int hw) {
-    moo.hw = hw;
-    if(moo.hw == DMG_HW) {
-        moo.mode = NON_CGB_MODE;
+    MOO.hw = hw;
+    if(MOO.hw == DMG_HW) {
+        MOO.mode = NON_CGB_MODE;
     }
     //serial_update_internal_period();
 }
 
-static void moo_cycle(int num) {
-    unsigned int t;
+// Instructions run between checks for the end of moo_run_frames()
+#define RUN_FRAMES_STEPS 64
+
+/*
+    Executes at least one and at most num instructions (or halted cycles),
+    returns how many. Iterations of busy waits skipped by jr aren't counted
+*/
+static inline int step(int num) {
+    if(CPU.halted) {
+        int idle = 1;
 
-    sys.invoke_cc = 0;
-    for(t = 0; t < num; t++) {
-        if(cpu.halted) {
-            if(ints_handle_standby()) {
-                cpu.halted = 0;
-            }
-            hw_step(1);
+        if(ints_handle_standby()) {
+            CPU.halted = 0;
         }
+#ifndef DEBUG
+        // Only an event can end the halt, so the time up to the next one passes at once
         else {
+            idle = (s32)(HW.deadline - HW.cc);
+            idle = max(1, min(idle, num));
+        }
+#endif
+        hw_step(idle);
+        return idle;
+    }
+
+#ifdef THREADED_DISPATCH
+    return op_run(num);
+#else
 #ifdef DEBUG
-            debug_step();
+    debug_step();
 #endif // DEBUG
-            u8 mcs = cpu_step();
-            hw_step(mcs);
-        }
+    u8 mcs = cpu_step();
+    hw_step(mcs);
+    return 1;
+#endif
+}
+
+void moo_cycle(int num) {
+    hw_cycle_t begin = HW.cc;
+    int t;
+
+    for(t = 0; t < num;) {
+        t += step(num - t);
+    }
+
+#ifdef LAZY_FLAGS
+    op_sync_flags();
+#endif
+    HW.invoke_cc = HW.cc - begin;
+}
+
+/*
+    Runs until num more vblanks happened. With the LCD off there are no
+    vblanks, so at most the time of num frames (plus a few instructions with
+    threaded dispatch) is emulated
+*/
+void moo_run_frames(int num) {
+    u32 until = LCD.frames + num;
+    hw_cycle_t begin = HW.cc;
+    hw_cycle_t max_cc = num * (hw_cycle_t)(CPU.freq / LCD_FRAMERATE + 1);
+
+    while(LCD.frames != until && HW.cc - begin < max_cc &&
+          (MOO.state & MOO_ROM_RUNNING_BIT)) {
+        step(RUN_FRAMES_STEPS);
     }
+
+#ifdef LAZY_FLAGS
+    op_sync_flags();
+#endif
+    HW.invoke_cc = HW.cc - begin;
 }
 
 void moo_main() {
-    while(moo.state & MOO_RUNNING_BIT) {
-        if(moo.state & MOO_ERROR_BIT){
+    while(MOO.state & MOO_RUNNING_BIT) {
+        if(MOO.state & MOO_ERROR_BIT){
             menu_error();
         }
-        else if(moo.state & MOO_ROM_RUNNING_BIT) {
+        else if(MOO.state & MOO_ROM_RUNNING_BIT) {
             moo_cycle(sys.quantum_length);
             sys_invoke();
         }
@@ -226,16 +288,16 @@ void moo_notifyf(const char *format, ...) {
     va_list args;
     va_start(args, format);
 
-    if(moo.error != NULL) {
-        free(moo.error);
+    if(MOO.error != NULL) {
+        free(MOO.error);
     }
 
-    moo.error = malloc(sizeof(*moo.error));
-    vsnprintf(moo.error->text, sizeof(moo.error->text), format, args);
+    MOO.error = malloc(sizeof(*MOO.error));
+    vsnprintf(MOO.error->text, sizeof(MOO.error->text), format, args);
 
     fprintf(stderr, "NOTIFICATION: "); vfprintf(stderr, format, args); fprintf(stderr, "\n");
 
-    moo.state |= MOO_ERROR_BIT;
+    MOO.state |= MOO_ERROR_BIT;
     moo_pause();
 
     va_end(args);
@@ -245,18 +307,18 @@ void moo_errorf(const char *format, ...) {
     va_list args;
     va_start(args, format);
 
-    if(moo.error != NULL) {
-        free(moo.error);
+    if(MOO.error != NULL) {
+        free(MOO.error);
     }
 
-    moo.error = malloc(sizeof(*moo.error));
-    vsnprintf(moo.error->text, sizeof(moo.error->text), format, args);
+    MOO.error = malloc(sizeof(*MOO.error));
+    vsnprintf(MOO.error->text, sizeof(MOO.error->text), format, args);
 
     fprintf(stderr, "ERROR: "); vfprintf(stderr, format, args); fprintf(stderr, "\n");
 
-    moo.state |= MOO_ERROR_BIT;
-    moo.state &= ~MOO_ROM_RUNNING_BIT;
-    moo.state &= ~MOO_ROM_LOADED_BIT;
+    MOO.state |= MOO_ERROR_BIT;
+    MOO.state &= ~MOO_ROM_RUNNING_BIT;
+    MOO.state &= ~MOO_ROM_LOADED_BIT;
 
     moo_reset();
 
@@ -274,13 +336,13 @@ void moo_fatalf(const char *format, ...) {
 }
 
 void moo_clear_error() {
-    if(moo.error != NULL) {
-        free(moo.error);
-        moo.error = NULL;
+    if(MOO.error != NULL) {
+        free(MOO.error);
+        MOO.error = NULL;
     }
-    moo.state &= ~MOO_ERROR_BIT;
+    MOO.state &= ~MOO_ERROR_BIT;
 
-    if(moo.state & MOO_ROM_LOADED_BIT) {
+    if(MOO.state & MOO_ROM_LOADED_BIT) {
         moo_continue();
     }
 }
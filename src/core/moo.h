@@ -27,7 +27,6 @@ typedef struct {
     moo_error_t *error;
 } moo_t;
 
-extern moo_t moo;
 
 void moo_init();
 void moo_reset();
@@ -44,6 +43,8 @@ void moo_load_rom(const char *path);
 void moo_load_rom_config();
 
 void moo_main();
+void moo_cycle(int num);
+void moo_run_frames(int num);
 
 void moo_set_joy_button(u8 button, u8 state);
 
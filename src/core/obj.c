@@ -2,14 +2,14 @@
 #include "moo.h"
 #include "mem.h"
 #include "lcd.h"
+#include "tile.h"
 #include "defines.h"
 #include <string.h>
 #include <stdio.h>
+#include "instance.h"
 
-#define MAX_PER_LINE 10
 #define OBJ_SIZE 4
 #define OAM_SIZE 0xA0
-#define OAM_OBJ_COUNT 40
 
 #define POSY_OFFSET 0
 #define POSX_OFFSET 1
@@ -27,85 +27,111 @@
 #define XFLIP(obj)  ((obj)[FLAGS_OFFSET] & XFLIP_BIT)
 #define YFLIP(obj)  ((obj)[FLAGS_OFFSET] & YFLIP_BIT)
 #define BANK(obj) (((obj)[FLAGS_OFFSET] & BANK_MASK) >> BANK_SHIFT)
+#define OBJ(index) (&RAM.oam[(index) * OBJ_SIZE])
 
 
-static u8 obj_height;
-static u8 obj_size_mode;
-static u8 priority;
-static u8 palette;
-static u16 *scan;
-static pixel_meta_t *meta;
-static obj_range_t *ranges;
-static int obj_count;
-static u8 *objs[OAM_OBJ_COUNT];
-
-static inline void render_pixel(u8 *line, u8 rshift, u8 sx) {
-    u8 lsb = (line[0] >> rshift) & 0x01;
-    u8 msb = (line[1] >> rshift) & 0x01;
-    u8 color_id = lsb + (msb << 1);
-
-    if(color_id != 0) {
-        meta[sx].color_id = color_id;
-        meta[sx].priority = priority;
-        scan[sx] = lcd.obp.map[palette][color_id];
+static __thread u8 obj_height;
+static __thread u8 obj_size_mode;
+static __thread u8 priority;
+static __thread u8 palette;
+static __thread u16 *scan;
+static __thread pixel_meta_t *meta;
+static __thread obj_range_t *ranges;
+static __thread int obj_count;
+static __thread u8 *objs[MAX_PER_LINE];
+static __thread u8 *sorted_objs[OAM_OBJ_COUNT];
+
+static inline void render_obj_line(u64 row, u8 tx, u8 sx) {
+    u16 colors[8];
+
+    tile_row_colors(row, LCD.obp.map[palette], colors);
+
+    for(; tx < 8 && sx < LCD_WIDTH; tx++, sx++) {
+        u8 color_id = tile_row_id(row, tx);
+
+        if(color_id != 0) {
+            meta[sx].color_id = color_id;
+            meta[sx].priority = priority;
+            scan[sx] = colors[tx];
+        }
     }
 }
 
-static inline void render_obj_line(u8 *line, u8 tx, u8 sx) {
-    s8 rshift;
-    for(rshift = 7 - tx; rshift >= 0 && sx < LCD_WIDTH; rshift--, sx++) {
-        render_pixel(line, rshift, sx);
-    }
+// Stable insertion sort of OAM indexes, before(a, b) moves a in front of b
+#define sort(indexes, before) { \
+    int o, i; \
+    for(o = 0; o < OAM_OBJ_COUNT; o++) { \
+        for(i = o; i > 0 && before(OBJ(o), OBJ(indexes[i-1])); i--) { \
+            indexes[i] = indexes[i-1]; \
+        } \
+        indexes[i] = o; \
+    } \
 }
 
-static inline void render_obj_line_flipped(u8 *line, u8 tx, u8 sx) {
-    u8 rshift;
-    for(rshift = tx; rshift < 8 && sx < LCD_WIDTH; rshift++, sx++) {
-        render_pixel(line, rshift, sx);
+#define left_of(a, b) (POSX(a) < POSX(b))
+#define right_of(a, b) (POSX(a) > POSX(b))
+
+/*
+    Puts the objects into buckets of the lines they cover, once after every
+    change to OAM or the object size. Each line gets all of its objects
+    ordered by X for compute_ranges() and up to MAX_PER_LINE in the order
+    they are drawn, last one on top
+*/
+static void bucket_objs() {
+    u8 by_x[OAM_OBJ_COUNT], drawn[OAM_OBJ_COUNT];
+    u8 drawn_size[LCD_HEIGHT];
+    int o, l;
+
+    sort(by_x, left_of);
+    if(MOO.mode == NON_CGB_MODE) {
+        sort(drawn, right_of);
     }
-}
+    else {
+        for(o = 0; o < OAM_OBJ_COUNT; o++) {
+            drawn[o] = o;
+        }
+    }
+
+    memset(LCD.obj_lines_size, 0x00, sizeof(LCD.obj_lines_size));
+    memset(drawn_size, 0x00, sizeof(drawn_size));
+
+    for(o = 0; o < OAM_OBJ_COUNT; o++) {
+        int top_line = (int)POSY(OBJ(by_x[o])) - 16;
 
-static void select_obj_indexes() {
-    u8 buf_index;
-    u8 *obj, *oam_end;
+        for(l = max(top_line, 0); l <= top_line + obj_height && l < LCD_HEIGHT; l++) {
+            LCD.obj_lines[l][LCD.obj_lines_size[l]++] = by_x[o];
+        }
+    }
 
-    buf_index = 0;
-    oam_end = ram.oam + OAM_SIZE;
-    for(obj = ram.oam; obj < oam_end; obj += OBJ_SIZE) {
-        s16 top_line = (s16)POSY(obj) - 16;
-        s16 bottom_line = top_line + obj_height;
+    for(o = 0; o < OAM_OBJ_COUNT; o++) {
+        int top_line = (int)POSY(OBJ(drawn[o])) - 16;
 
-        if((s16)lcd.ly >= top_line && (s16)lcd.ly <= bottom_line) {
-            objs[buf_index++] = obj;
+        for(l = max(top_line, 0); l <= top_line + obj_height && l < LCD_HEIGHT; l++) {
+            if(drawn_size[l] < MAX_PER_LINE) {
+                LCD.obj_lines_drawn[l][drawn_size[l]++] = drawn[o];
+            }
         }
     }
 
-    obj_count = buf_index;
+    LCD.obj_lines_dirty = 0;
 }
 
-#define sort(objs, cmp) { \
-    u8 switched; \
-    do { \
-        u8 o; \
-        switched = 0; \
-        for(o = 0; o + 1 < obj_count; o++) { \
-            if(POSX(objs[o]) cmp POSX(objs[o+1])) { \
-                u8 *tmp = objs[o]; \
-                objs[o] = objs[o+1]; \
-                objs[o+1] = tmp; \
-                switched = 1; \
-            } \
-        } \
-    } while(switched); \
+static void select_objs() {
+    u8 *line = LCD.obj_lines[LCD.ly];
+    int o;
+
+    obj_count = LCD.obj_lines_size[LCD.ly];
+
+    for(o = 0; o < obj_count; o++) {
+        sorted_objs[o] = OBJ(line[o]);
+    }
+    for(o = 0; o < min(obj_count, MAX_PER_LINE); o++) {
+        objs[o] = OBJ(LCD.obj_lines_drawn[LCD.ly][o]);
+    }
 }
 
 static int compute_ranges() {
-    u8 *sorted_objs[OAM_OBJ_COUNT];
     int num = 0;
-
-    memcpy(sorted_objs, objs, sizeof(*sorted_objs) * obj_count);
-    sort(sorted_objs, >);
-
     int r, o;
     int last_range_end = 0;
 
@@ -138,7 +164,7 @@ static void render_obj(u8 *obj) {
     s16 sx;
     u8 tx;
 
-    obj_line = lcd.ly - (POSY(obj) - 16);
+    obj_line = LCD.ly - (POSY(obj) - 16);
     if(YFLIP(obj)) {
         obj_line = obj_height - obj_line;
     }
@@ -148,7 +174,7 @@ static void render_obj(u8 *obj) {
         tile_index &= 0xFE;
     }
 
-    line_data = &ram.vrambanks[moo.mode == CGB_MODE ? BANK(obj) : 0][tile_index*0x10 + obj_line*0x02];
+    line_data = &RAM.vrambanks[MOO.mode == CGB_MODE ? BANK(obj) : 0][tile_index*0x10 + obj_line*0x02];
     sx = POSX(obj) - 8;
 
     if(sx < 0) {
@@ -160,14 +186,9 @@ static void render_obj(u8 *obj) {
     }
 
     priority = obj[FLAGS_OFFSET] & 0x80;
-    palette = moo.mode == CGB_MODE ? obj[FLAGS_OFFSET] & 0x07 : (obj[FLAGS_OFFSET] >> 4) & 0x01;
+    palette = MOO.mode == CGB_MODE ? obj[FLAGS_OFFSET] & 0x07 : (obj[FLAGS_OFFSET] >> 4) & 0x01;
 
-    if(XFLIP(obj)) {
-        render_obj_line_flipped(line_data, tx, sx);
-    }
-    else {
-        render_obj_line(line_data, tx, sx);
-    }
+    render_obj_line(XFLIP(obj) ? tile_row_flipped(line_data) : tile_row(line_data), tx, sx);
 }
 
 
@@ -176,17 +197,17 @@ void lcd_scan_obj(u16 *_scan, pixel_meta_t *_meta, obj_range_t *_ranges, int *nu
     meta = _meta;
     ranges = _ranges;
 
-    obj_size_mode = lcd.c & LCDC_OBJ_SIZE_BIT;
+    obj_size_mode = LCD.c & LCDC_OBJ_SIZE_BIT;
     obj_height = (obj_size_mode ? 15 : 7);
 
-    select_obj_indexes();
-    *num_obj_ranges = compute_ranges();
-
-    if(moo.mode == NON_CGB_MODE) {
-        sort(objs, <);
+    if(LCD.obj_lines_dirty) {
+        bucket_objs();
     }
 
-    obj_count = obj_count > MAX_PER_LINE ? MAX_PER_LINE : obj_count;
+    select_objs();
+    *num_obj_ranges = compute_ranges();
+
+    obj_count = min(obj_count, MAX_PER_LINE);
 
     int o;
     for(o = obj_count-1; o >= 0; o--) {
@@ -194,4 +215,6 @@ void lcd_scan_obj(u16 *_scan, pixel_meta_t *_meta, obj_range_t *_ranges, int *nu
     }
 }
 
-
+void obj_dirty() {
+    LCD.obj_lines_dirty = 1;
+}
@@ -19,5 +19,6 @@ typedef struct {
 } obj_range_t;
 
 void lcd_scan_obj(u16 *scan, pixel_meta_t *meta, obj_range_t *ranges, int *num_obj_ranges);
+void obj_dirty();
 
 #endif
@@ -5,9 +5,13 @@
 #include "moo.h"
 #include "hw.h"
 #include "mem.h"
+#include "ints.h"
+#include "lcd.h"
+#include "sound.h"
 #include "defines.h"
+#include "instance.h"
 
-static u8 mcs[256] = {
+static const u8 mcs[256] = {
 //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
     1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1, // 0
     1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1, // 1
@@ -27,7 +31,7 @@ static u8 mcs[256] = {
     2, 3, 2, 1, 1, 4, 2, 4, 3, 2, 2, 1, 1, 1, 2, 4  // F
 };
 
-static u8 preread_mcs[256] = {
+static const u8 preread_mcs[256] = {
 //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 1
@@ -47,7 +51,7 @@ static u8 preread_mcs[256] = {
     1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0  // F
 };
 
-static u8 prewrite_mcs[256] = {
+static const u8 prewrite_mcs[256] = {
 //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 1
@@ -67,7 +71,7 @@ static u8 prewrite_mcs[256] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0  // F
 };
 
-static u8 cb_preread_mcs[256] = {
+static const u8 cb_preread_mcs[256] = {
 //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
     0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, // 0
     0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, // 1
@@ -87,7 +91,7 @@ static u8 cb_preread_mcs[256] = {
     0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0  // F
 };
 
-static u8 cb_prewrite_mcs[256] = {
+static const u8 cb_prewrite_mcs[256] = {
 //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
     0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, // 0
     0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, // 1
@@ -118,50 +122,123 @@ static void push(u16 w) {
     mem_write_word(SP, w);
 }
 
+/*
+    Code is fetched straight through the page table, only pages without a
+    direct pointer take the full mem_read_byte()
+*/
 static inline u8 fetch_byte() {
+#ifndef DEBUG
+    u8 *page = RAM.read_pages[PC >> 12];
+    if(page != NULL) {
+        return page[PC++ & 0x0FFF];
+    }
+#endif
     return mem_read_byte(PC++);
 }
 
 static inline u16 fetch_word() {
-    u16 word = mem_read_word(PC);
+    u16 word;
+
+#ifndef DEBUG
+    u8 *page = RAM.read_pages[PC >> 12];
+    if(page != NULL && (PC & 0x0FFF) != 0x0FFF) {
+        word = page[PC & 0x0FFF] | (page[(PC & 0x0FFF) + 1] << 8);
+        PC += 2;
+        return word;
+    }
+#endif
+
+    word = mem_read_word(PC);
     PC += 2;
     return word;
 }
 
 static inline void write_byte(u16 adr, u8 val) {
-    hw_step(prewrite_mcs[cpu.op]);
+    hw_step(prewrite_mcs[CPU.op]);
     mem_write_byte(adr, val);
 }
 
 static inline void cb_write_byte(u16 adr, u8 val) {
-    hw_step(cb_prewrite_mcs[cpu.cb]);
+    hw_step(cb_prewrite_mcs[CPU.cb]);
     mem_write_byte(adr, val);
 }
 
 static inline void write_word(u16 adr, u16 val) {
-    hw_step(prewrite_mcs[cpu.op]);
+    hw_step(prewrite_mcs[CPU.op]);
     mem_write_word(adr, val);
 }
 
 static inline u8 read_byte(u16 adr) {
-    hw_step(preread_mcs[cpu.op]);
+    hw_step(preread_mcs[CPU.op]);
     return mem_read_byte(adr);
 }
 
 static inline u8 cb_read_byte(u16 adr) {
-    hw_step(cb_preread_mcs[cpu.cb]);
+    hw_step(cb_preread_mcs[CPU.cb]);
     return mem_read_byte(adr);
 }
 
+/*
+    With lazy flags add, adc, sub, sbc, cp, inc and dec only note their
+    operands and result, from which F is computed once something reads it.
+    Mostly the next arithmetic op overwrites them before that. C is bit 8 of
+    the result, inc and dec carry the previous C over into it
+*/
+#ifdef LAZY_FLAGS
+static inline void sync_flags() {
+    if(CPU.lazy_op != LAZY_NONE) {
+        F = FZZ((u8)CPU.lazy_r) |
+            (CPU.lazy_op & FNBIT) |
+            (FHBIT & ((CPU.lazy_a ^ CPU.lazy_b ^ CPU.lazy_r) << 1)) |
+            (FCBIT & (CPU.lazy_r >> 4));
+        CPU.lazy_op = LAZY_NONE;
+    }
+}
+
+void op_sync_flags() {
+    sync_flags();
+}
+
+// Conditions only need Z or C, which come straight from the pending result
+#undef FZ
+#undef FC
+#define FZ (CPU.lazy_op != LAZY_NONE ? FZZ((u8)CPU.lazy_r) : (F & FZBIT))
+#define FC (CPU.lazy_op != LAZY_NONE ? (FCBIT & (CPU.lazy_r >> 4)) : (F & FCBIT))
+#else
+static inline void sync_flags() {
+}
+#endif
+
+static inline void arith_flags(u8 kind, u8 a, u8 b, u16 r) {
+#ifdef LAZY_FLAGS
+    CPU.lazy_op = kind;
+    CPU.lazy_a = a;
+    CPU.lazy_b = b;
+    CPU.lazy_r = r;
+#else
+    F = FZZ((u8)r) |
+        (kind & FNBIT) |
+        (FHBIT & ((a ^ b ^ r) << 1)) |
+        (FCBIT & (r >> 4));
+#endif
+}
+
+static inline void set_flags(u8 f) {
+#ifdef LAZY_FLAGS
+    CPU.lazy_op = LAZY_NONE;
+#endif
+    F = f;
+}
+
 static inline u8 rlc(u8 byte) {
     byte = (byte<<1) | (byte>>7);
-    F = FZZ(byte) | FCB0(byte);
+    set_flags(FZZ(byte) | FCB0(byte));
     return byte;
 }
 
 static inline u8 rrc(u8 byte) {
     byte = (byte>>1) | (byte<<7);
-    F = FZZ(byte) | FCB7(byte);
+    set_flags(FZZ(byte) | FCB7(byte));
     return byte;
 }
 
@@ -178,14 +255,14 @@ static inline void rrca() {
 static inline u8 rl(u8 byte) {
     u8 fc = FCB7(byte);
     byte = (byte<<1) | (FC>>4);
-    F = FZZ(byte) | fc;
+    set_flags(FZZ(byte) | fc);
     return byte;
 }
 
 static inline u8 rr(u8 byte) {
     u8 fc = FCB0(byte);
     byte = (byte>>1) | (FC<<3);
-    F = FZZ(byte) | fc;
+    set_flags(FZZ(byte) | fc);
     return byte;
 }
 
@@ -202,32 +279,32 @@ static inline void rra() {
 static inline u8 sla(u8 byte) {
     u8 fc = FCB7(byte);
     byte <<= 1;
-    F = FZZ(byte) | fc;
+    set_flags(FZZ(byte) | fc);
     return byte;
 }
 
 static inline u8 sra(u8 byte) {
     u8 fc = FCB0(byte);
     byte = (byte & 0x80) | (byte >> 1);
-    F = FZZ(byte) | fc;
+    set_flags(FZZ(byte) | fc);
     return byte;
 }
 
 static inline u8 swap(u8 byte) {
     byte = ((byte & 0x0F) << 4) | (byte >> 4);
-    F = FZZ(byte);
+    set_flags(FZZ(byte));
     return byte;
 }
 
 static inline u8 srl(u8 byte) {
     u8 fc = FCB0(byte);
     byte >>= 1;
-    F = FZZ(byte) | fc;
+    set_flags(FZZ(byte) | fc);
     return byte;
 }
 
 static inline u8 bit(u8 b, u8 byte) {
-    F = FZZ(byte & (1<<b)) | FHBIT | FC;
+    set_flags(FZZ(byte & (1<<b)) | FHBIT | FC);
     return byte;
 }
 
@@ -242,6 +319,7 @@ static inline u8 set(u8 b, u8 byte) {
 static inline void daa() {
     int a = A;
 
+    sync_flags();
     if (!FN) {
         if (FH || (a & 0xF) > 9)
             a += 0x06;
@@ -265,21 +343,85 @@ static inline void daa() {
 }
 
 static inline void scf() {
-    F = FZ | FCBIT;
+    set_flags(FZ | FCBIT);
 }
 
 static inline void ccf() {
-    F = FZ | (FC ? 0 : FCBIT);
+    set_flags(FZ | (FC ? 0 : FCBIT));
 }
 
 static inline void cpl() {
     A ^= 0xFF;
-    F = FZ | FNBIT | FHBIT | FC;
+    set_flags(FZ | FNBIT | FHBIT | FC);
+}
+
+/*
+    Busy waits like
+        wait: ldh a, (ff44)
+              cp 0x90
+              jr nz, wait
+    read a value that only an event (or an interrupt, which needs an event
+    to be raised) can change. Until the next event each iteration thus ends
+    in the very same state, so the time of all but the last one can be
+    skipped at once. PC is at the start of the loop, whose last iteration
+    ended with jr's offset byte
+*/
+#ifndef DEBUG
+static int is_event_register(u16 adr) {
+    switch(adr) {
+        case 0xFF04: case 0xFF05: case 0xFF0F: case 0xFF41: case 0xFF44:
+            return 1;
+        default:
+            return (adr >= 0xFF80 && adr < 0xFFFF) || (adr >= 0xC000 && adr < 0xE000);
+    }
 }
 
+static void skip_busy_wait(u8 offset) {
+    u8 *page = RAM.read_pages[PC >> 12];
+    const u8 *loop;
+    int length = -(s8)offset, load, mcs, iterations;
+
+    if(page == NULL || (PC & 0x0FFF) + length > 0x1000) {
+        return;
+    }
+    if(CPU.ime != IME_OFF && (CPU.ime != IME_ON || (CPU.irq & CPU.ie))) {
+        return;
+    }
+    loop = &page[PC & 0x0FFF];
+
+    if(loop[0] == 0xF0 && is_event_register(0xFF00 + loop[1])) {
+        load = 2;
+    }
+    else if(loop[0] == 0xFA && is_event_register(loop[1] | (loop[2] << 8))) {
+        load = 3;
+    }
+    else {
+        return;
+    }
+
+    // Only a test of A may follow: cp n, and n, and a or or a
+    switch(length - load) {
+        case 4: if(loop[load] != 0xFE && loop[load] != 0xE6) return; break;
+        case 3: if(loop[load] != 0xA7 && loop[load] != 0xB7) return; break;
+        default: return;
+    }
+
+    mcs = op_cycles(loop[0]) + op_cycles(loop[load]) + 3;
+    iterations = (s32)(HW.deadline - 1 - HW.cc) / mcs;
+    if(iterations > 0) {
+        HW.cc += iterations * mcs;
+    }
+}
+#endif
+
 static inline int jr(int cond, u8 val) {
     if(cond) {
         PC += (s8)val;
+#ifndef DEBUG
+        if((s8)val < -4 && (s8)val > -8) {
+            skip_busy_wait(val);
+        }
+#endif
         return 3;
     }
     else {
@@ -324,17 +466,18 @@ static inline int call(int cond, u16 adr) {
 }
 
 static inline void stop() {
-    if(cpu.freq_switch) {
-        if(cpu.freq == NORMAL_CPU_FREQ) {
-            cpu.freq = DOUBLE_CPU_FREQ;
-            cpu.freq_factor = 2;
+    if(CPU.freq_switch) {
+        sound_sync(); // Sound converts cycles to its clock by the speed
+        if(CPU.freq == NORMAL_CPU_FREQ) {
+            CPU.freq = DOUBLE_CPU_FREQ;
+            CPU.freq_factor = 2;
         }
         else {
-            cpu.freq = NORMAL_CPU_FREQ;
-            cpu.freq_factor = 1;
+            CPU.freq = NORMAL_CPU_FREQ;
+            CPU.freq_factor = 1;
         }
 
-        cpu.freq_switch = 0x00;
+        CPU.freq_switch = 0x00;
     }
     else {
 
@@ -342,28 +485,23 @@ static inline void stop() {
 }
 
 static inline void halt() {
-    if(cpu.ime == IME_OFF) {
-        cpu.halted = 1;
+    if(CPU.ime == IME_OFF) {
+        CPU.halted = 1;
     }
     else {
-        cpu.halted = 1;
+        CPU.halted = 1;
     }
 }
 
 static inline u8 inc_byte(u8 byte) {
-    u16 r = (u16)byte + 1;
-    F = FZZ((u8)r) |
-        (FHBIT & ((byte ^ r) << 1)) |
-        FC;
+    u8 r = byte + 1;
+    arith_flags(LAZY_ADD, byte, 0, r | (FC << 4));
     return r;
 }
 
 static inline u8 dec_byte(u8 byte) {
     u8 r = byte - 1;
-    F = FZZ((u8)r) |
-        FNBIT |
-        (FHBIT & ((byte ^ r) << 1)) |
-        FC;
+    arith_flags(LAZY_SUB, byte, 0, r | (FC << 4));
     return r;
 }
 
@@ -381,65 +519,55 @@ static inline void dec_mem(u16 adr) {
 
 static inline void add(u8 byte) {
     u16 r = (u16)A + (u16)byte;
-    F = FZZ((u8)r) |
-        (FHBIT & ((A ^ byte ^ r) << 1)) |
-        (FCBIT & (r >> 4));
+    arith_flags(LAZY_ADD, A, byte, r);
     A = (u8)r;
 }
 
 static inline void adc(u8 byte) {
     u8 fc = FC ? 1 : 0;
     u16 r = (u16)A + (u16)byte + (u16)fc;
-    F = FZZ((u8)r) |
-        (FHBIT & ((A ^ byte ^ fc ^ r) << 1)) |
-        (FCBIT & (r >> 4));
+    arith_flags(LAZY_ADD, A, byte, r);
     A = (u8)r;
 }
 
 static inline void sub(u8 byte) {
     u16 r = (u16)A - (u16)byte;
-    F = FZZ((u8)r) |
-        FNBIT |
-        (FHBIT & ((A ^ byte ^ r) << 1)) |
-        (FCBIT & (r >> 4));
+    arith_flags(LAZY_SUB, A, byte, r);
     A = (u8)r;
 }
 
 static inline void sbc(u8 byte) {
     u8 fc = FC ? 1 : 0;
     u16 r = (u16)A - (u16)byte - (u16)fc;
-    F = FZZ((u8)r) |
-        FNBIT |
-        (FHBIT & ((A ^ byte ^ fc ^ r) << 1)) |
-        (FCBIT & (r >> 4));
+    arith_flags(LAZY_SUB, A, byte, r);
     A = (u8)r;
 }
 
 static inline void and(u8 byte) {
     A &= byte;
-    F = FZZ(A) | FHBIT;
+    set_flags(FZZ(A) | FHBIT);
 }
 
 static inline void xor(u8 byte) {
     A ^= byte;
-    F = FZZ(A);
+    set_flags(FZZ(A));
 }
 
 static inline void or(u8 byte) {
     A |= byte;
-    F = FZZ(A);
+    set_flags(FZZ(A));
 }
 
 static inline void cp(u8 byte) {
     u16 r = (u16)A - (u16)byte;
-    F = FZZ((u8)r) | FNBIT | (FHBIT & ((A ^ byte ^ r) << 1)) | (FCBIT & (r >> 4));
+    arith_flags(LAZY_SUB, A, byte, r);
 }
 
 static inline u16 add_word(u16 a, u16 b) {
     u32 r = (u32)a + (u32)b;
-    F = FZ |
-        (FHBIT & ((a ^ b ^ r) >> 7)) |
-        (FCBIT & (r >> 12));
+    set_flags(FZ |
+              (FHBIT & ((a ^ b ^ r) >> 7)) |
+              (FCBIT & (r >> 12)));
     return (u16)r;
 }
 
@@ -447,7 +575,7 @@ static inline void add_sp(u8 byte) {
     s8 o = (s8)byte;
     u32 r = (u32)SP + o;
 
-    F = 0x00;
+    set_flags(0x00);
     if ((r & 0xFF) < (SP & 0xFF)) {
         F |= FCBIT;
     }
@@ -462,7 +590,7 @@ static inline void ld_hl_spi() {
     s8 o = (s8)fetch_byte();
     u32 r = (u32)SP + o;
 
-    F = 0;
+    set_flags(0);
     if ((r & 0xFF) < (SP & 0xFF))
       F |= FCBIT;
     if ((r & 0xF) < (SP & 0xF))
@@ -471,9 +599,15 @@ static inline void ld_hl_spi() {
     HL = (u16)r;
 }
 
+static inline void pop_af() {
+    u16 af = pop();
+    A = af >> 8;
+    set_flags(af & 0xF0);
+}
+
 static inline void reti() {
     PC = pop();
-    cpu.ime = IME_ON;
+    CPU.ime = IME_ON;
 }
 
 #define CB_OP_CASES_NOARG(base, func) \
@@ -509,7 +643,7 @@ static inline void reti() {
 
 
 static inline int cb() {
-    switch(cpu.cb) {
+    switch(CPU.cb) {
         CB_OP_CASES_NOARG(0x00, rlc);
         CB_OP_CASES_NOARG(0x08, rrc);
         CB_OP_CASES_NOARG(0x10, rl);
@@ -527,287 +661,341 @@ static inline int cb() {
     return 2;
 }
 
+/*
+    Every opcode's handler is written once and ends in OP_END, which returns
+    the opcode's constant cycle cost for the switch, or, with threaded dispatch,
+    steps the hardware and jumps straight into the next opcode's handler
+*/
+#ifdef THREADED_DISPATCH
+#define OP(op) op_##op:
+#define OP_END_MCS(op_mcs) do { \
+        int end_mcs = (op_mcs); \
+        hw_step(end_mcs); \
+        if(++executed == num || CPU.halted || LCD.frames != frames) { \
+            return executed; \
+        } \
+        ints_handle(); \
+        CPU.op = fetch_byte(); \
+        goto *dispatch[CPU.op]; \
+    } while(0)
+
+#define OP_LABEL_ROW(hi) \
+    &&op_0x##hi##0, &&op_0x##hi##1, &&op_0x##hi##2, &&op_0x##hi##3, \
+    &&op_0x##hi##4, &&op_0x##hi##5, &&op_0x##hi##6, &&op_0x##hi##7, \
+    &&op_0x##hi##8, &&op_0x##hi##9, &&op_0x##hi##A, &&op_0x##hi##B, \
+    &&op_0x##hi##C, &&op_0x##hi##D, &&op_0x##hi##E, &&op_0x##hi##F
+#else
+#define OP(op) case op:
+#define OP_END_MCS(op_mcs) return (op_mcs)
+#endif
+#define OP_END(op) OP_END_MCS(mcs[op])
+
+#ifdef THREADED_DISPATCH
+int op_run(int num) {
+    static const void *const dispatch[256] = {
+        OP_LABEL_ROW(0), OP_LABEL_ROW(1), OP_LABEL_ROW(2), OP_LABEL_ROW(3),
+        OP_LABEL_ROW(4), OP_LABEL_ROW(5), OP_LABEL_ROW(6), OP_LABEL_ROW(7),
+        OP_LABEL_ROW(8), OP_LABEL_ROW(9), OP_LABEL_ROW(A), OP_LABEL_ROW(B),
+        OP_LABEL_ROW(C), OP_LABEL_ROW(D), OP_LABEL_ROW(E), OP_LABEL_ROW(F)
+    };
+    u32 frames = LCD.frames;
+    int executed = 0;
+
+    ints_handle();
+    CPU.op = fetch_byte();
+    goto *dispatch[CPU.op];
+
+    {
+#else
 int op_exec() {
+    CPU.op = fetch_byte();
 
-    switch(cpu.op) {
-        case 0x00: break;
-        case 0x01: BC = fetch_word(); break;
-        case 0x02: write_byte(BC, A); break;
-        case 0x03: BC++; break;
-        case 0x04: B = inc_byte(B); break;
-        case 0x05: B = dec_byte(B); break;
-        case 0x06: B = fetch_byte(); break;
-        case 0x07: rlca(); break;
-        case 0x08: write_word(fetch_word(), SP); break;
-        case 0x09: HL = add_word(HL, BC); break;
-        case 0x0A: A = read_byte(BC); break;
-        case 0x0B: BC--; break;
-        case 0x0C: C = inc_byte(C); break;
-        case 0x0D: C = dec_byte(C); break;
-        case 0x0E: C = fetch_byte(); break;
-        case 0x0F: rrca(); break;
-
-        case 0x10: stop(); break;
-        case 0x11: DE = fetch_word(); break;
-        case 0x12: write_byte(DE, A); break;
-        case 0x13: DE++; break;
-        case 0x14: D = inc_byte(D); break;
-        case 0x15: D = dec_byte(D); break;
-        case 0x16: D = fetch_byte(); break;
-        case 0x17: rla(); break;
-        case 0x18: return jr(1, fetch_byte());
-        case 0x19: HL = add_word(HL, DE); break;
-        case 0x1A: A = read_byte(DE); break;
-        case 0x1B: DE--; break;
-        case 0x1C: E = inc_byte(E); break;
-        case 0x1D: E = dec_byte(E); break;
-        case 0x1E: E = fetch_byte(); break;
-        case 0x1F: rra(); break;
-
-        case 0x20: return jr(!FZ, fetch_byte());
-        case 0x21: HL = fetch_word(); break;
-        case 0x22: write_byte(HL++, A); break;
-        case 0x23: HL++; break;
-        case 0x24: H = inc_byte(H); break;
-        case 0x25: H = dec_byte(H); break;
-        case 0x26: H = fetch_byte(); break;
-        case 0x27: daa(); break;
-        case 0x28: return jr(FZ, fetch_byte());
-        case 0x29: HL = add_word(HL, HL); break;
-        case 0x2A: A = read_byte(HL++); break;
-        case 0x2B: HL--; break;
-        case 0x2C: L = inc_byte(L); break;
-        case 0x2D: L = dec_byte(L); break;
-        case 0x2E: L = fetch_byte(); break;
-        case 0x2F: cpl(); break;
-
-        case 0x30: return jr(!FC, fetch_byte());
-        case 0x31: SP = fetch_word(); break;
-        case 0x32: write_byte(HL--, A); break;
-        case 0x33: SP++; break;
-        case 0x34: inc_mem(HL); break;
-        case 0x35: dec_mem(HL); break;
-        case 0x36: write_byte(HL, fetch_byte()); break;
-        case 0x37: scf(); break;
-        case 0x38: return jr(FC, fetch_byte());
-        case 0x39: HL = add_word(HL, SP); break;
-        case 0x3A: A = read_byte(HL--); break;
-        case 0x3B: SP--; break;
-        case 0x3C: A = inc_byte(A); break;
-        case 0x3D: A = dec_byte(A); break;
-        case 0x3E: A = fetch_byte(); break;
-        case 0x3F: ccf(); break;
-
-        case 0x40: B = B; break;
-        case 0x41: B = C; break;
-        case 0x42: B = D; break;
-        case 0x43: B = E; break;
-        case 0x44: B = H; break;
-        case 0x45: B = L; break;
-        case 0x46: B = read_byte(HL); break;
-        case 0x47: B = A; break;
-        case 0x48: C = B; break;
-        case 0x49: C = C; break;
-        case 0x4A: C = D; break;
-        case 0x4B: C = E; break;
-        case 0x4C: C = H; break;
-        case 0x4D: C = L; break;
-        case 0x4E: C = read_byte(HL); break;
-        case 0x4F: C = A; break;
-
-        case 0x50: D = B; break;
-        case 0x51: D = C; break;
-        case 0x52: D = D; break;
-        case 0x53: D = E; break;
-        case 0x54: D = H; break;
-        case 0x55: D = L; break;
-        case 0x56: D = read_byte(HL); break;
-        case 0x57: D = A; break;
-        case 0x58: E = B; break;
-        case 0x59: E = C; break;
-        case 0x5A: E = D; break;
-        case 0x5B: E = E; break;
-        case 0x5C: E = H; break;
-        case 0x5D: E = L; break;
-        case 0x5E: E = read_byte(HL); break;
-        case 0x5F: E = A; break;
-
-        case 0x60: H = B; break;
-        case 0x61: H = C; break;
-        case 0x62: H = D; break;
-        case 0x63: H = E; break;
-        case 0x64: H = H; break;
-        case 0x65: H = L; break;
-        case 0x66: H = read_byte(HL); break;
-        case 0x67: H = A; break;
-        case 0x68: L = B; break;
-        case 0x69: L = C; break;
-        case 0x6A: L = D; break;
-        case 0x6B: L = E; break;
-        case 0x6C: L = H; break;
-        case 0x6D: L = L; break;
-        case 0x6E: L = read_byte(HL); break;
-        case 0x6F: L = A; break;
-
-        case 0x70: write_byte(HL, B); break;
-        case 0x71: write_byte(HL, C); break;
-        case 0x72: write_byte(HL, D); break;
-        case 0x73: write_byte(HL, E); break;
-        case 0x74: write_byte(HL, H); break;
-        case 0x75: write_byte(HL, L); break;
-        case 0x76: halt(); break;
-        case 0x77: write_byte(HL, A); break;
-        case 0x78: A = B; break;
-        case 0x79: A = C; break;
-        case 0x7A: A = D; break;
-        case 0x7B: A = E; break;
-        case 0x7C: A = H; break;
-        case 0x7D: A = L; break;
-        case 0x7E: A = read_byte(HL); break;
-        case 0x7F: A = A; break;
-
-        case 0x80: add(B); break;
-        case 0x81: add(C); break;
-        case 0x82: add(D); break;
-        case 0x83: add(E); break;
-        case 0x84: add(H); break;
-        case 0x85: add(L); break;
-        case 0x86: add(read_byte(HL)); break;
-        case 0x87: add(A); break;
-        case 0x88: adc(B); break;
-        case 0x89: adc(C); break;
-        case 0x8A: adc(D); break;
-        case 0x8B: adc(E); break;
-        case 0x8C: adc(H); break;
-        case 0x8D: adc(L); break;
-        case 0x8E: adc(read_byte(HL)); break;
-        case 0x8F: adc(A); break;
-
-        case 0x90: sub(B); break;
-        case 0x91: sub(C); break;
-        case 0x92: sub(D); break;
-        case 0x93: sub(E); break;
-        case 0x94: sub(H); break;
-        case 0x95: sub(L); break;
-        case 0x96: sub(read_byte(HL)); break;
-        case 0x97: sub(A); break;
-        case 0x98: sbc(B); break;
-        case 0x99: sbc(C); break;
-        case 0x9A: sbc(D); break;
-        case 0x9B: sbc(E); break;
-        case 0x9C: sbc(H); break;
-        case 0x9D: sbc(L); break;
-        case 0x9E: sbc(read_byte(HL)); break;
-        case 0x9F: sbc(A); break;
-
-        case 0xA0: and(B); break;
-        case 0xA1: and(C); break;
-        case 0xA2: and(D); break;
-        case 0xA3: and(E); break;
-        case 0xA4: and(H); break;
-        case 0xA5: and(L); break;
-        case 0xA6: and(read_byte(HL)); break;
-        case 0xA7: and(A); break;
-        case 0xA8: xor(B); break;
-        case 0xA9: xor(C); break;
-        case 0xAA: xor(D); break;
-        case 0xAB: xor(E); break;
-        case 0xAC: xor(H); break;
-        case 0xAD: xor(L); break;
-        case 0xAE: xor(read_byte(HL)); break;
-        case 0xAF: xor(A); break;
-
-        case 0xB0: or(B); break;
-        case 0xB1: or(C); break;
-        case 0xB2: or(D); break;
-        case 0xB3: or(E); break;
-        case 0xB4: or(H); break;
-        case 0xB5: or(L); break;
-        case 0xB6: or(read_byte(HL)); break;
-        case 0xB7: or(A); break;
-        case 0xB8: cp(B); break;
-        case 0xB9: cp(C); break;
-        case 0xBA: cp(D); break;
-        case 0xBB: cp(E); break;
-        case 0xBC: cp(H); break;
-        case 0xBD: cp(L); break;
-        case 0xBE: cp(read_byte(HL)); break;
-        case 0xBF: cp(A); break;
-
-        case 0xC0: return ret(!FZ);
-        case 0xC1: BC = pop(); break;
-        case 0xC2: return jp(!FZ, fetch_word());
-        case 0xC3: return jp(1, fetch_word());
-        case 0xC4: return call(!FZ, fetch_word());
-        case 0xC5: push(BC); break;
-        case 0xC6: add(fetch_byte()); break;
-        case 0xC7: rst(0x00); break;
-        case 0xC8: return ret(FZ);
-        case 0xC9: PC = pop(); break;
-        case 0xCA: return jp(FZ, fetch_word());
-        case 0xCB: cpu.cb = fetch_byte(); return cb();
-        case 0xCC: return call(FZ, fetch_word());
-        case 0xCD: return call(1, fetch_word());
-        case 0xCE: adc(fetch_byte()); break;
-        case 0xCF: rst(0x08); break;
-
-        case 0xD0: return ret(!FC);
-        case 0xD1: DE = pop(); break;
-        case 0xD2: return jp(!FC, fetch_word());
-        case 0xD3: break;
-        case 0xD4: return call(!FC, fetch_word());
-        case 0xD5: push(DE); break;
-        case 0xD6: sub(fetch_byte()); break;
-        case 0xD7: rst(0x10); break;
-        case 0xD8: return ret(FC);
-        case 0xD9: reti(); break;
-        case 0xDA: return jp(FC, fetch_word());
-        case 0xDB: break;
-        case 0xDC: return call(FC, fetch_word());
-        case 0xDD: break;
-        case 0xDE: sbc(fetch_byte()); break;
-        case 0xDF: rst(0x18); break;
-
-        case 0xE0: write_byte(0xFF00 + fetch_byte(), A); break;
-        case 0xE1: HL = pop(); break;
-        case 0xE2: write_byte(0xFF00 + C, A); break;
-        case 0xE3: break;
-        case 0xE4: break;
-        case 0xE5: push(HL); break;
-        case 0xE6: and(fetch_byte()); break;
-        case 0xE7: rst(0x20); break;
-        case 0xE8: add_sp(fetch_byte()); break;
-        case 0xE9: PC = HL; break;
-        case 0xEA: write_byte(fetch_word(), A); break;
-        case 0xEB: break;
-        case 0xEC: break;
-        case 0xED: break;
-        case 0xEE: xor(fetch_byte()); break;
-        case 0xEF: rst(0x28); break;
-
-        case 0xF0: A = read_byte(0xFF00 + fetch_byte()); break;
-        case 0xF1: AF = pop() & 0xFFF0; break;
-        case 0xF2: A = read_byte(0xFF00 + C); break;
-        case 0xF3: cpu.ime = cpu.ime == IME_ON ? IME_DOWN : cpu.ime; break;
-        case 0xF4: break;
-        case 0xF5: push(AF); break;
-        case 0xF6: or(fetch_byte()); break;
-        case 0xF7: rst(0x30); break;
-        case 0xF8: ld_hl_spi(); break;
-        case 0xF9: SP = HL; break;
-        case 0xFA: A = read_byte(fetch_word()); break;
-        case 0xFB: cpu.ime = cpu.ime == IME_OFF ? IME_UP : cpu.ime; break;
-        case 0xFC: break;
-        case 0xFD: break;
-        case 0xFE: cp(fetch_byte()); break;
-        case 0xFF: rst(0x38); break;
-
+    switch(CPU.op) {
+#endif
+        OP(0x00) OP_END(0x00);
+        OP(0x01) BC = fetch_word(); OP_END(0x01);
+        OP(0x02) write_byte(BC, A); OP_END(0x02);
+        OP(0x03) BC++; OP_END(0x03);
+        OP(0x04) B = inc_byte(B); OP_END(0x04);
+        OP(0x05) B = dec_byte(B); OP_END(0x05);
+        OP(0x06) B = fetch_byte(); OP_END(0x06);
+        OP(0x07) rlca(); OP_END(0x07);
+        OP(0x08) write_word(fetch_word(), SP); OP_END(0x08);
+        OP(0x09) HL = add_word(HL, BC); OP_END(0x09);
+        OP(0x0A) A = read_byte(BC); OP_END(0x0A);
+        OP(0x0B) BC--; OP_END(0x0B);
+        OP(0x0C) C = inc_byte(C); OP_END(0x0C);
+        OP(0x0D) C = dec_byte(C); OP_END(0x0D);
+        OP(0x0E) C = fetch_byte(); OP_END(0x0E);
+        OP(0x0F) rrca(); OP_END(0x0F);
+
+        OP(0x10) stop(); OP_END(0x10);
+        OP(0x11) DE = fetch_word(); OP_END(0x11);
+        OP(0x12) write_byte(DE, A); OP_END(0x12);
+        OP(0x13) DE++; OP_END(0x13);
+        OP(0x14) D = inc_byte(D); OP_END(0x14);
+        OP(0x15) D = dec_byte(D); OP_END(0x15);
+        OP(0x16) D = fetch_byte(); OP_END(0x16);
+        OP(0x17) rla(); OP_END(0x17);
+        OP(0x18) OP_END_MCS(jr(1, fetch_byte()));
+        OP(0x19) HL = add_word(HL, DE); OP_END(0x19);
+        OP(0x1A) A = read_byte(DE); OP_END(0x1A);
+        OP(0x1B) DE--; OP_END(0x1B);
+        OP(0x1C) E = inc_byte(E); OP_END(0x1C);
+        OP(0x1D) E = dec_byte(E); OP_END(0x1D);
+        OP(0x1E) E = fetch_byte(); OP_END(0x1E);
+        OP(0x1F) rra(); OP_END(0x1F);
+
+        OP(0x20) OP_END_MCS(jr(!FZ, fetch_byte()));
+        OP(0x21) HL = fetch_word(); OP_END(0x21);
+        OP(0x22) write_byte(HL++, A); OP_END(0x22);
+        OP(0x23) HL++; OP_END(0x23);
+        OP(0x24) H = inc_byte(H); OP_END(0x24);
+        OP(0x25) H = dec_byte(H); OP_END(0x25);
+        OP(0x26) H = fetch_byte(); OP_END(0x26);
+        OP(0x27) daa(); OP_END(0x27);
+        OP(0x28) OP_END_MCS(jr(FZ, fetch_byte()));
+        OP(0x29) HL = add_word(HL, HL); OP_END(0x29);
+        OP(0x2A) A = read_byte(HL++); OP_END(0x2A);
+        OP(0x2B) HL--; OP_END(0x2B);
+        OP(0x2C) L = inc_byte(L); OP_END(0x2C);
+        OP(0x2D) L = dec_byte(L); OP_END(0x2D);
+        OP(0x2E) L = fetch_byte(); OP_END(0x2E);
+        OP(0x2F) cpl(); OP_END(0x2F);
+
+        OP(0x30) OP_END_MCS(jr(!FC, fetch_byte()));
+        OP(0x31) SP = fetch_word(); OP_END(0x31);
+        OP(0x32) write_byte(HL--, A); OP_END(0x32);
+        OP(0x33) SP++; OP_END(0x33);
+        OP(0x34) inc_mem(HL); OP_END(0x34);
+        OP(0x35) dec_mem(HL); OP_END(0x35);
+        OP(0x36) write_byte(HL, fetch_byte()); OP_END(0x36);
+        OP(0x37) scf(); OP_END(0x37);
+        OP(0x38) OP_END_MCS(jr(FC, fetch_byte()));
+        OP(0x39) HL = add_word(HL, SP); OP_END(0x39);
+        OP(0x3A) A = read_byte(HL--); OP_END(0x3A);
+        OP(0x3B) SP--; OP_END(0x3B);
+        OP(0x3C) A = inc_byte(A); OP_END(0x3C);
+        OP(0x3D) A = dec_byte(A); OP_END(0x3D);
+        OP(0x3E) A = fetch_byte(); OP_END(0x3E);
+        OP(0x3F) ccf(); OP_END(0x3F);
+
+        OP(0x40) B = B; OP_END(0x40);
+        OP(0x41) B = C; OP_END(0x41);
+        OP(0x42) B = D; OP_END(0x42);
+        OP(0x43) B = E; OP_END(0x43);
+        OP(0x44) B = H; OP_END(0x44);
+        OP(0x45) B = L; OP_END(0x45);
+        OP(0x46) B = read_byte(HL); OP_END(0x46);
+        OP(0x47) B = A; OP_END(0x47);
+        OP(0x48) C = B; OP_END(0x48);
+        OP(0x49) C = C; OP_END(0x49);
+        OP(0x4A) C = D; OP_END(0x4A);
+        OP(0x4B) C = E; OP_END(0x4B);
+        OP(0x4C) C = H; OP_END(0x4C);
+        OP(0x4D) C = L; OP_END(0x4D);
+        OP(0x4E) C = read_byte(HL); OP_END(0x4E);
+        OP(0x4F) C = A; OP_END(0x4F);
+
+        OP(0x50) D = B; OP_END(0x50);
+        OP(0x51) D = C; OP_END(0x51);
+        OP(0x52) D = D; OP_END(0x52);
+        OP(0x53) D = E; OP_END(0x53);
+        OP(0x54) D = H; OP_END(0x54);
+        OP(0x55) D = L; OP_END(0x55);
+        OP(0x56) D = read_byte(HL); OP_END(0x56);
+        OP(0x57) D = A; OP_END(0x57);
+        OP(0x58) E = B; OP_END(0x58);
+        OP(0x59) E = C; OP_END(0x59);
+        OP(0x5A) E = D; OP_END(0x5A);
+        OP(0x5B) E = E; OP_END(0x5B);
+        OP(0x5C) E = H; OP_END(0x5C);
+        OP(0x5D) E = L; OP_END(0x5D);
+        OP(0x5E) E = read_byte(HL); OP_END(0x5E);
+        OP(0x5F) E = A; OP_END(0x5F);
+
+        OP(0x60) H = B; OP_END(0x60);
+        OP(0x61) H = C; OP_END(0x61);
+        OP(0x62) H = D; OP_END(0x62);
+        OP(0x63) H = E; OP_END(0x63);
+        OP(0x64) H = H; OP_END(0x64);
+        OP(0x65) H = L; OP_END(0x65);
+        OP(0x66) H = read_byte(HL); OP_END(0x66);
+        OP(0x67) H = A; OP_END(0x67);
+        OP(0x68) L = B; OP_END(0x68);
+        OP(0x69) L = C; OP_END(0x69);
+        OP(0x6A) L = D; OP_END(0x6A);
+        OP(0x6B) L = E; OP_END(0x6B);
+        OP(0x6C) L = H; OP_END(0x6C);
+        OP(0x6D) L = L; OP_END(0x6D);
+        OP(0x6E) L = read_byte(HL); OP_END(0x6E);
+        OP(0x6F) L = A; OP_END(0x6F);
+
+        OP(0x70) write_byte(HL, B); OP_END(0x70);
+        OP(0x71) write_byte(HL, C); OP_END(0x71);
+        OP(0x72) write_byte(HL, D); OP_END(0x72);
+        OP(0x73) write_byte(HL, E); OP_END(0x73);
+        OP(0x74) write_byte(HL, H); OP_END(0x74);
+        OP(0x75) write_byte(HL, L); OP_END(0x75);
+        OP(0x76) halt(); OP_END(0x76);
+        OP(0x77) write_byte(HL, A); OP_END(0x77);
+        OP(0x78) A = B; OP_END(0x78);
+        OP(0x79) A = C; OP_END(0x79);
+        OP(0x7A) A = D; OP_END(0x7A);
+        OP(0x7B) A = E; OP_END(0x7B);
+        OP(0x7C) A = H; OP_END(0x7C);
+        OP(0x7D) A = L; OP_END(0x7D);
+        OP(0x7E) A = read_byte(HL); OP_END(0x7E);
+        OP(0x7F) A = A; OP_END(0x7F);
+
+        OP(0x80) add(B); OP_END(0x80);
+        OP(0x81) add(C); OP_END(0x81);
+        OP(0x82) add(D); OP_END(0x82);
+        OP(0x83) add(E); OP_END(0x83);
+        OP(0x84) add(H); OP_END(0x84);
+        OP(0x85) add(L); OP_END(0x85);
+        OP(0x86) add(read_byte(HL)); OP_END(0x86);
+        OP(0x87) add(A); OP_END(0x87);
+        OP(0x88) adc(B); OP_END(0x88);
+        OP(0x89) adc(C); OP_END(0x89);
+        OP(0x8A) adc(D); OP_END(0x8A);
+        OP(0x8B) adc(E); OP_END(0x8B);
+        OP(0x8C) adc(H); OP_END(0x8C);
+        OP(0x8D) adc(L); OP_END(0x8D);
+        OP(0x8E) adc(read_byte(HL)); OP_END(0x8E);
+        OP(0x8F) adc(A); OP_END(0x8F);
+
+        OP(0x90) sub(B); OP_END(0x90);
+        OP(0x91) sub(C); OP_END(0x91);
+        OP(0x92) sub(D); OP_END(0x92);
+        OP(0x93) sub(E); OP_END(0x93);
+        OP(0x94) sub(H); OP_END(0x94);
+        OP(0x95) sub(L); OP_END(0x95);
+        OP(0x96) sub(read_byte(HL)); OP_END(0x96);
+        OP(0x97) sub(A); OP_END(0x97);
+        OP(0x98) sbc(B); OP_END(0x98);
+        OP(0x99) sbc(C); OP_END(0x99);
+        OP(0x9A) sbc(D); OP_END(0x9A);
+        OP(0x9B) sbc(E); OP_END(0x9B);
+        OP(0x9C) sbc(H); OP_END(0x9C);
+        OP(0x9D) sbc(L); OP_END(0x9D);
+        OP(0x9E) sbc(read_byte(HL)); OP_END(0x9E);
+        OP(0x9F) sbc(A); OP_END(0x9F);
+
+        OP(0xA0) and(B); OP_END(0xA0);
+        OP(0xA1) and(C); OP_END(0xA1);
+        OP(0xA2) and(D); OP_END(0xA2);
+        OP(0xA3) and(E); OP_END(0xA3);
+        OP(0xA4) and(H); OP_END(0xA4);
+        OP(0xA5) and(L); OP_END(0xA5);
+        OP(0xA6) and(read_byte(HL)); OP_END(0xA6);
+        OP(0xA7) and(A); OP_END(0xA7);
+        OP(0xA8) xor(B); OP_END(0xA8);
+        OP(0xA9) xor(C); OP_END(0xA9);
+        OP(0xAA) xor(D); OP_END(0xAA);
+        OP(0xAB) xor(E); OP_END(0xAB);
+        OP(0xAC) xor(H); OP_END(0xAC);
+        OP(0xAD) xor(L); OP_END(0xAD);
+        OP(0xAE) xor(read_byte(HL)); OP_END(0xAE);
+        OP(0xAF) xor(A); OP_END(0xAF);
+
+        OP(0xB0) or(B); OP_END(0xB0);
+        OP(0xB1) or(C); OP_END(0xB1);
+        OP(0xB2) or(D); OP_END(0xB2);
+        OP(0xB3) or(E); OP_END(0xB3);
+        OP(0xB4) or(H); OP_END(0xB4);
+        OP(0xB5) or(L); OP_END(0xB5);
+        OP(0xB6) or(read_byte(HL)); OP_END(0xB6);
+        OP(0xB7) or(A); OP_END(0xB7);
+        OP(0xB8) cp(B); OP_END(0xB8);
+        OP(0xB9) cp(C); OP_END(0xB9);
+        OP(0xBA) cp(D); OP_END(0xBA);
+        OP(0xBB) cp(E); OP_END(0xBB);
+        OP(0xBC) cp(H); OP_END(0xBC);
+        OP(0xBD) cp(L); OP_END(0xBD);
+        OP(0xBE) cp(read_byte(HL)); OP_END(0xBE);
+        OP(0xBF) cp(A); OP_END(0xBF);
+
+        OP(0xC0) OP_END_MCS(ret(!FZ));
+        OP(0xC1) BC = pop(); OP_END(0xC1);
+        OP(0xC2) OP_END_MCS(jp(!FZ, fetch_word()));
+        OP(0xC3) OP_END_MCS(jp(1, fetch_word()));
+        OP(0xC4) OP_END_MCS(call(!FZ, fetch_word()));
+        OP(0xC5) push(BC); OP_END(0xC5);
+        OP(0xC6) add(fetch_byte()); OP_END(0xC6);
+        OP(0xC7) rst(0x00); OP_END(0xC7);
+        OP(0xC8) OP_END_MCS(ret(FZ));
+        OP(0xC9) PC = pop(); OP_END(0xC9);
+        OP(0xCA) OP_END_MCS(jp(FZ, fetch_word()));
+        OP(0xCB) CPU.cb = fetch_byte(); OP_END_MCS(cb());
+        OP(0xCC) OP_END_MCS(call(FZ, fetch_word()));
+        OP(0xCD) OP_END_MCS(call(1, fetch_word()));
+        OP(0xCE) adc(fetch_byte()); OP_END(0xCE);
+        OP(0xCF) rst(0x08); OP_END(0xCF);
+
+        OP(0xD0) OP_END_MCS(ret(!FC));
+        OP(0xD1) DE = pop(); OP_END(0xD1);
+        OP(0xD2) OP_END_MCS(jp(!FC, fetch_word()));
+        OP(0xD3) OP_END(0xD3);
+        OP(0xD4) OP_END_MCS(call(!FC, fetch_word()));
+        OP(0xD5) push(DE); OP_END(0xD5);
+        OP(0xD6) sub(fetch_byte()); OP_END(0xD6);
+        OP(0xD7) rst(0x10); OP_END(0xD7);
+        OP(0xD8) OP_END_MCS(ret(FC));
+        OP(0xD9) reti(); OP_END(0xD9);
+        OP(0xDA) OP_END_MCS(jp(FC, fetch_word()));
+        OP(0xDB) OP_END(0xDB);
+        OP(0xDC) OP_END_MCS(call(FC, fetch_word()));
+        OP(0xDD) OP_END(0xDD);
+        OP(0xDE) sbc(fetch_byte()); OP_END(0xDE);
+        OP(0xDF) rst(0x18); OP_END(0xDF);
+
+        OP(0xE0) write_byte(0xFF00 + fetch_byte(), A); OP_END(0xE0);
+        OP(0xE1) HL = pop(); OP_END(0xE1);
+        OP(0xE2) write_byte(0xFF00 + C, A); OP_END(0xE2);
+        OP(0xE3) OP_END(0xE3);
+        OP(0xE4) OP_END(0xE4);
+        OP(0xE5) push(HL); OP_END(0xE5);
+        OP(0xE6) and(fetch_byte()); OP_END(0xE6);
+        OP(0xE7) rst(0x20); OP_END(0xE7);
+        OP(0xE8) add_sp(fetch_byte()); OP_END(0xE8);
+        OP(0xE9) PC = HL; OP_END(0xE9);
+        OP(0xEA) write_byte(fetch_word(), A); OP_END(0xEA);
+        OP(0xEB) OP_END(0xEB);
+        OP(0xEC) OP_END(0xEC);
+        OP(0xED) OP_END(0xED);
+        OP(0xEE) xor(fetch_byte()); OP_END(0xEE);
+        OP(0xEF) rst(0x28); OP_END(0xEF);
+
+        OP(0xF0) A = read_byte(0xFF00 + fetch_byte()); OP_END(0xF0);
+        OP(0xF1) pop_af(); OP_END(0xF1);
+        OP(0xF2) A = read_byte(0xFF00 + C); OP_END(0xF2);
+        OP(0xF3) CPU.ime = CPU.ime == IME_ON ? IME_DOWN : CPU.ime; OP_END(0xF3);
+        OP(0xF4) OP_END(0xF4);
+        OP(0xF5) sync_flags(); push(AF); OP_END(0xF5);
+        OP(0xF6) or(fetch_byte()); OP_END(0xF6);
+        OP(0xF7) rst(0x30); OP_END(0xF7);
+        OP(0xF8) ld_hl_spi(); OP_END(0xF8);
+        OP(0xF9) SP = HL; OP_END(0xF9);
+        OP(0xFA) A = read_byte(fetch_word()); OP_END(0xFA);
+        OP(0xFB) CPU.ime = CPU.ime == IME_OFF ? IME_UP : CPU.ime; OP_END(0xFB);
+        OP(0xFC) OP_END(0xFC);
+        OP(0xFD) OP_END(0xFD);
+        OP(0xFE) cp(fetch_byte()); OP_END(0xFE);
+        OP(0xFF) rst(0x38); OP_END(0xFF);
+
+#ifndef THREADED_DISPATCH
         default:;
 #ifdef DEBUG
-            printf("op %.2X not implemented\n", cpu.op);
+            printf("op %.2X not implemented\n", CPU.op);
+#endif
 #endif
     }
 
-    return mcs[cpu.op];
+    return mcs[CPU.op];
+}
+
+int op_cycles(u8 op) {
+    return preread_mcs[op] + mcs[op] + prewrite_mcs[op];
 }
 
@@ -3,6 +3,27 @@
 
 #include "defines.h"
 
+// The debugger has to be able to stop between any two instructions
+#if defined(THREADED_DISPATCH) && defined(DEBUG)
+#undef THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+/*
+    Runs up to num instructions, each followed by its hw_step(). Returns the
+    number executed, earlier if the CPU halted or a frame was completed
+*/
+int op_run(int num);
+#else
 int op_exec();
+#endif
+
+// Cycles of an opcode that doesn't branch, including its memory accesses
+int op_cycles(u8 op);
+
+#ifdef LAZY_FLAGS
+// Writes pending lazy flags to F, before anything outside ops.c reads it
+void op_sync_flags();
+#endif
 
 #endif
@@ -0,0 +1,23 @@
+#ifndef CORE_OPS_BENCH_H
+#define CORE_OPS_BENCH_H
+
+#include "defines.h"
+
+/*
+    ops.c compiled once more with either dispatch, whichever the build
+    uses itself, so mooboy-headless --bench-dispatch can run the same
+    instructions through both. Not part of the core
+*/
+
+// Executes one instruction like op_exec() with switch dispatch
+int ops_switch_exec();
+
+// Runs up to num instructions like op_run() with threaded dispatch
+int ops_threaded_run(int num);
+
+#ifdef LAZY_FLAGS
+void ops_switch_sync_flags();
+void ops_threaded_sync_flags();
+#endif
+
+#endif
@@ -0,0 +1,10 @@
+// ops.c with switch dispatch for --bench-dispatch, see ops_bench.h
+#include "ops_bench.h"
+
+#undef THREADED_DISPATCH
+
+#define op_exec ops_switch_exec
+#define op_cycles ops_switch_cycles
+#define op_sync_flags ops_switch_sync_flags
+
+#include "ops.c"
@@ -0,0 +1,12 @@
+// ops.c with threaded dispatch for --bench-dispatch, see ops_bench.h
+#include "ops_bench.h"
+
+#ifndef THREADED_DISPATCH
+#define THREADED_DISPATCH
+#endif
+
+#define op_run ops_threaded_run
+#define op_cycles ops_threaded_cycles
+#define op_sync_flags ops_threaded_sync_flags
+
+#include "ops.c"
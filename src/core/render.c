@@ -0,0 +1,292 @@
+#include "render.h"
+#include <stdlib.h>
+#include <string.h>
+#include "lcd.h"
+#include "maps.h"
+#include "obj.h"
+#include "instance.h"
+
+#ifdef RENDER_THREAD
+#include <pthread.h>
+
+#define RING_MASK (RENDER_RING_SIZE - 1)
+#define WAKE_LINES 16 // The render thread is woken up every this many lines
+
+enum {
+    CMD_VRAM,
+    CMD_OAM,
+    CMD_CGB_PALETTE,
+    CMD_DMG_PALETTE,
+    CMD_LINE
+};
+
+typedef union {
+    u8 type;
+    struct {
+        u8 type;
+        u8 bank; // Or whether the palette is OBP
+        u8 val;
+        u16 adr;
+    } write;
+    struct {
+        u8 type;
+        u8 c, scx, scy, wx, wy, ly;
+    } line;
+} render_cmd_t;
+
+struct render_s {
+    moo_instance_t *shadow;
+
+    // head is only written by the emulation thread, tail by the render thread
+    render_cmd_t ring[RENDER_RING_SIZE];
+    u32 head, tail;
+
+    int sleeping;
+    int quit;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, drained;
+};
+
+// Runs on the render thread with the shadow instance selected
+static void replay(const render_cmd_t *cmd) {
+    lcd_palettes_t *palettes = cmd->write.bank ? &LCD.obp : &LCD.bgp;
+
+    switch(cmd->type) {
+        case CMD_VRAM:
+            RAM.selected_vrambank = cmd->write.bank;
+            lcd_vram_write(0x8000 + cmd->write.adr, cmd->write.val);
+        break;
+
+        case CMD_OAM:
+            RAM.oam[cmd->write.adr] = cmd->write.val;
+            obj_dirty();
+        break;
+
+        case CMD_CGB_PALETTE:
+            palettes->s = cmd->write.adr;
+            palettes->i = 0;
+            lcd_cgb_palette_data(palettes, cmd->write.val);
+        break;
+
+        case CMD_DMG_PALETTE:
+            lcd_dmg_palette_data(palettes, cmd->write.val, cmd->write.adr);
+        break;
+
+        case CMD_LINE:
+            if((LCD.c ^ cmd->line.c) & LCDC_TILE_DATA_BIT) {
+                maps_dirty();
+            }
+            if((LCD.c ^ cmd->line.c) & LCDC_OBJ_SIZE_BIT) {
+                obj_dirty();
+            }
+
+            LCD.c = cmd->line.c;
+            LCD.scx = cmd->line.scx;
+            LCD.scy = cmd->line.scy;
+            LCD.wx = cmd->line.wx;
+            LCD.wy = cmd->line.wy;
+            LCD.ly = cmd->line.ly;
+
+            lcd_draw_line();
+        break;
+    }
+}
+
+static void *run(void *arg) {
+    render_t *r = arg;
+    u32 head, tail;
+    int quit = 0;
+
+    moo_instance_select(r->shadow);
+
+    while(!quit) {
+        tail = r->tail;
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+        if(tail == head) {
+            pthread_mutex_lock(&r->lock);
+            __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+            pthread_cond_broadcast(&r->drained);
+
+            while(!r->quit && __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == tail) {
+                pthread_cond_wait(&r->wake, &r->lock);
+            }
+
+            __atomic_store_n(&r->sleeping, 0, __ATOMIC_SEQ_CST);
+            quit = r->quit;
+            pthread_mutex_unlock(&r->lock);
+            continue;
+        }
+
+        for(; tail != head; tail++) {
+            replay(&r->ring[tail & RING_MASK]);
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static void wake(render_t *r) {
+    if(__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&r->lock);
+        pthread_cond_signal(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+static void push(const render_cmd_t *cmd) {
+    render_t *r = RENDERER;
+    u32 head = r->head;
+
+    if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= RENDER_RING_SIZE) {
+        render_sync();
+    }
+
+    r->ring[head & RING_MASK] = *cmd;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+}
+
+static void push_write(u8 type, u8 bank, u16 adr, u8 val) {
+    render_cmd_t cmd;
+
+    cmd.write.type = type;
+    cmd.write.bank = bank;
+    cmd.write.adr = adr;
+    cmd.write.val = val;
+
+    push(&cmd);
+}
+
+void render_vram_write(u8 bank, u16 vram_adr, u8 val) {
+    push_write(CMD_VRAM, bank, vram_adr, val);
+}
+
+void render_oam_write(u8 adr, u8 val) {
+    push_write(CMD_OAM, 0, adr, val);
+}
+
+void render_cgb_palette_data(int obp, u8 s, u8 val) {
+    push_write(CMD_CGB_PALETTE, obp, s, val);
+}
+
+void render_dmg_palette_data(int obp, u8 s, u8 val) {
+    push_write(CMD_DMG_PALETTE, obp, s, val);
+}
+
+void render_line() {
+    render_cmd_t cmd;
+
+    cmd.line.type = CMD_LINE;
+    cmd.line.c = LCD.c;
+    cmd.line.scx = LCD.scx;
+    cmd.line.scy = LCD.scy;
+    cmd.line.wx = LCD.wx;
+    cmd.line.wy = LCD.wy;
+    cmd.line.ly = LCD.ly;
+
+    push(&cmd);
+
+    if(LCD.ly % WAKE_LINES == WAKE_LINES - 1) {
+        wake(RENDERER);
+    }
+}
+
+void render_sync() {
+    render_t *r = RENDERER;
+
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_signal(&r->wake);
+    while(__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) != r->head) {
+        pthread_cond_wait(&r->drained, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+void render_set_fb(u16 *fb) {
+    moo_instance_t *instance = moo_instance;
+
+    moo_instance_select(RENDERER->shadow);
+    LCD.working_fb = fb;
+    moo_instance_select(instance);
+}
+
+void render_enable() {
+    render_t *r;
+
+    if(RENDERER != NULL) {
+        return;
+    }
+
+    r = calloc(1, sizeof(*r));
+    r->shadow = moo_instance_create();
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    pthread_cond_init(&r->drained, NULL);
+
+    RENDERER = r;
+    render_resync();
+
+    pthread_create(&r->thread, NULL, run, r);
+}
+
+void render_disable() {
+    render_t *r = RENDERER;
+
+    if(r == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    r->quit = 1;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+
+    pthread_cond_destroy(&r->drained);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+
+    moo_instance_destroy(r->shadow);
+    free(r);
+    RENDERER = NULL;
+}
+
+void render_resync() {
+    moo_instance_t *instance = moo_instance;
+    render_t *r = RENDERER;
+    const ram_t *src_ram = &RAM;
+    const lcd_t *src_lcd = &LCD;
+    int mode = MOO.mode;
+
+    if(r == NULL) {
+        return;
+    }
+
+    render_sync();
+
+    moo_instance_select(r->shadow);
+
+    MOO.mode = mode;
+    memcpy(RAM.vrambanks, src_ram->vrambanks, sizeof(RAM.vrambanks));
+    memcpy(RAM.oam, src_ram->oam, sizeof(RAM.oam));
+
+    lcd_reset();
+    LCD.c = src_lcd->c;
+    LCD.bgp = src_lcd->bgp;
+    LCD.obp = src_lcd->obp;
+    LCD.working_fb = src_lcd->working_fb;
+    maps_dirty();
+
+    moo_instance_select(instance);
+}
+
+#else
+
+void render_enable() {}
+void render_disable() {}
+void render_resync() {}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CORE_RENDER_H
+#define CORE_RENDER_H
+
+#include "defines.h"
+
+/*
+    Draws the lines of an instance on a thread of its own. The emulation
+    thread only logs the registers of each line and every write to VRAM,
+    OAM and the palettes into a ring, the render thread replays them on a
+    shadow instance, which owns the tile caches, and draws into the
+    instance's working framebuffer. Only at vblank does the emulation
+    thread wait for the frame to be complete.
+*/
+
+#define RENDER_RING_SIZE 0x10000 // Commands, power of two
+
+typedef struct render_s render_t;
+
+// Start and stop the render thread of the selected instance
+void render_enable();
+void render_disable();
+
+// Copies the state the lines are drawn from, after a reset or state load
+void render_resync();
+
+#ifdef RENDER_THREAD
+void render_vram_write(u8 bank, u16 vram_adr, u8 val);
+void render_oam_write(u8 adr, u8 val);
+void render_cgb_palette_data(int obp, u8 s, u8 val);
+void render_dmg_palette_data(int obp, u8 s, u8 val);
+void render_line();
+
+// Waits until every logged line is drawn, later ones go into fb
+void render_sync();
+void render_set_fb(u16 *fb);
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+#include "resampler.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#endif
+
+#define CUTOFF 0.45 // Of the lower of both rates
+#define KERNEL_SHIFT 14
+#define PHASE_BITS 7 // log2(RESAMPLER_PHASES)
+#define BLEND_BITS 15
+
+static void build_kernel(resampler_t *resampler) {
+    double fc = CUTOFF * min(resampler->in_rate, resampler->out_rate) / resampler->in_rate;
+    double x, h[RESAMPLER_TAPS], sum;
+    s32 total;
+    int p, t;
+
+    for(p = 0; p <= RESAMPLER_PHASES; p++) {
+        sum = 0.0;
+        for(t = 0; t < RESAMPLER_TAPS; t++) {
+            x = t - (RESAMPLER_TAPS / 2 - 1) - (double)p / RESAMPLER_PHASES;
+            h[t] = x == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x);
+            h[t] *= 0.42 + 0.5 * cos(2.0 * M_PI * x / RESAMPLER_TAPS) + 0.08 * cos(4.0 * M_PI * x / RESAMPLER_TAPS);
+            sum += h[t];
+        }
+
+        total = 0;
+        for(t = 0; t < RESAMPLER_TAPS; t++) {
+            resampler->kernel[p][t] = lround(h[t] / sum * (1 << KERNEL_SHIFT));
+            total += resampler->kernel[p][t];
+        }
+
+        // Unity gain, whatever the rounding did
+        resampler->kernel[p][RESAMPLER_TAPS / 2 - 1 + (p >= RESAMPLER_PHASES / 2)] += (1 << KERNEL_SHIFT) - total;
+    }
+}
+
+/*
+    d[0], d[1] are the left samples filtered by k0 and k1, d[2], d[3] the
+    right ones
+*/
+static void filter(const s16 *l, const s16 *r, const s16 *k0, const s16 *k1, s32 *d) {
+#if defined(RESAMPLER_SSE2)
+    __m128i a0 = _mm_setzero_si128(), a1 = a0, a2 = a0, a3 = a0;
+    __m128i x, y, c0, c1, s01, s23;
+    int t;
+
+    for(t = 0; t < RESAMPLER_TAPS; t += 8) {
+        x = _mm_loadu_si128((const __m128i*)&l[t]);
+        y = _mm_loadu_si128((const __m128i*)&r[t]);
+        c0 = _mm_loadu_si128((const __m128i*)&k0[t]);
+        c1 = _mm_loadu_si128((const __m128i*)&k1[t]);
+
+        a0 = _mm_add_epi32(a0, _mm_madd_epi16(x, c0));
+        a1 = _mm_add_epi32(a1, _mm_madd_epi16(x, c1));
+        a2 = _mm_add_epi32(a2, _mm_madd_epi16(y, c0));
+        a3 = _mm_add_epi32(a3, _mm_madd_epi16(y, c1));
+    }
+
+    // Sum up each accumulator's lanes into one lane of the result
+    s01 = _mm_add_epi32(_mm_unpacklo_epi32(a0, a1), _mm_unpackhi_epi32(a0, a1));
+    s23 = _mm_add_epi32(_mm_unpacklo_epi32(a2, a3), _mm_unpackhi_epi32(a2, a3));
+    _mm_storeu_si128((__m128i*)d, _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23)));
+#elif defined(RESAMPLER_NEON)
+    int32x4_t a0 = vdupq_n_s32(0), a1 = a0, a2 = a0, a3 = a0;
+    int16x8_t x, y, c0, c1;
+    int32x2_t s01, s23;
+    int t;
+
+    for(t = 0; t < RESAMPLER_TAPS; t += 8) {
+        x = vld1q_s16(&l[t]);
+        y = vld1q_s16(&r[t]);
+        c0 = vld1q_s16(&k0[t]);
+        c1 = vld1q_s16(&k1[t]);
+
+        a0 = vmlal_s16(vmlal_s16(a0, vget_low_s16(x), vget_low_s16(c0)), vget_high_s16(x), vget_high_s16(c0));
+        a1 = vmlal_s16(vmlal_s16(a1, vget_low_s16(x), vget_low_s16(c1)), vget_high_s16(x), vget_high_s16(c1));
+        a2 = vmlal_s16(vmlal_s16(a2, vget_low_s16(y), vget_low_s16(c0)), vget_high_s16(y), vget_high_s16(c0));
+        a3 = vmlal_s16(vmlal_s16(a3, vget_low_s16(y), vget_low_s16(c1)), vget_high_s16(y), vget_high_s16(c1));
+    }
+
+    s01 = vpadd_s32(vadd_s32(vget_low_s32(a0), vget_high_s32(a0)), vadd_s32(vget_low_s32(a1), vget_high_s32(a1)));
+    s23 = vpadd_s32(vadd_s32(vget_low_s32(a2), vget_high_s32(a2)), vadd_s32(vget_low_s32(a3), vget_high_s32(a3)));
+    vst1q_s32(d, vcombine_s32(s01, s23));
+#else
+    int t;
+
+    d[0] = d[1] = d[2] = d[3] = 0;
+    for(t = 0; t < RESAMPLER_TAPS; t++) {
+        d[0] += l[t] * k0[t];
+        d[1] += l[t] * k1[t];
+        d[2] += r[t] * k0[t];
+        d[3] += r[t] * k1[t];
+    }
+#endif
+}
+
+static inline s16 blend(s32 d0, s32 d1, s32 w) {
+    s32 s = (d0 + (s32)(((s64)(d1 - d0) * w) >> BLEND_BITS) + (1 << (KERNEL_SHIFT - 1))) >> KERNEL_SHIFT;
+
+    return s > 32767 ? 32767 : s < -32768 ? -32768 : s;
+}
+
+void resampler_init(resampler_t *resampler, int in_rate, int out_rate) {
+    memset(resampler, 0x00, sizeof(*resampler));
+
+    resampler->in_rate = in_rate;
+    resampler->out_rate = out_rate;
+    resampler->step = ((u64)in_rate << 32) / out_rate;
+    resampler->adjusted_step = resampler->step;
+
+    build_kernel(resampler);
+}
+
+void resampler_adjust(resampler_t *resampler, int ppm) {
+    resampler->adjusted_step = resampler->step + (s64)resampler->step * ppm / 1000000;
+}
+
+int resampler_run(resampler_t *resampler, const s16 *in, int num, s16 *out) {
+    s16 *l = resampler->history[0];
+    s16 *r = resampler->history[1];
+    u32 frac, i, used;
+    s32 d[4], w;
+    int s, p;
+
+    num = min(num, RESAMPLER_MAX_INPUT);
+    for(s = 0; s < num; s++) {
+        l[resampler->length + s] = in[s*2 + 0];
+        r[resampler->length + s] = in[s*2 + 1];
+    }
+    resampler->length += num;
+
+    for(s = 0; (resampler->pos >> 32) + RESAMPLER_TAPS <= resampler->length; s++) {
+        i = resampler->pos >> 32;
+        frac = (u32)resampler->pos;
+        p = frac >> (32 - PHASE_BITS);
+        w = (frac >> (32 - PHASE_BITS - BLEND_BITS)) & ((1 << BLEND_BITS) - 1);
+
+        filter(&l[i], &r[i], resampler->kernel[p], resampler->kernel[p + 1], d);
+        out[s*2 + 0] = blend(d[0], d[1], w);
+        out[s*2 + 1] = blend(d[2], d[3], w);
+
+        resampler->pos += resampler->adjusted_step;
+    }
+
+    // Keep only what later output samples still need
+    used = min(resampler->pos >> 32, (u32)resampler->length);
+    memmove(l, &l[used], (resampler->length - used) * sizeof(*l));
+    memmove(r, &r[used], (resampler->length - used) * sizeof(*r));
+    resampler->length -= used;
+    resampler->pos -= (u64)used << 32;
+
+    return s;
+}
@@ -0,0 +1,42 @@
+#ifndef CORE_RESAMPLER_H
+#define CORE_RESAMPLER_H
+
+#include "defines.h"
+
+/*
+    Converts stereo samples from one rate to another with a polyphase
+    windowed sinc filter. The output position is kept in 32.32 fixed point,
+    each output sample blends the two nearest of RESAMPLER_PHASES filter
+    phases (SSE2 or NEON if available). The ratio can be nudged while
+    running, e.g. to keep the fill level of a device's buffer stable
+*/
+
+#define RESAMPLER_TAPS 48 // Multiple of 8
+#define RESAMPLER_PHASES 128
+#define RESAMPLER_MAX_INPUT 1024 // Samples per resampler_run() at most
+
+typedef struct {
+    int in_rate, out_rate;
+    u64 step; // Input samples per output sample, 32.32 fixed point
+    u64 adjusted_step;
+    u64 pos; // Of the next output sample, from the start of history
+
+    int length; // Samples in history
+    s16 history[2][RESAMPLER_TAPS + RESAMPLER_MAX_INPUT];
+
+    // Phase p holds the taps for an output p/RESAMPLER_PHASES samples late
+    s16 kernel[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+} resampler_t;
+
+void resampler_init(resampler_t *resampler, int in_rate, int out_rate);
+
+// Deviates the ratio by ppm, positive values produce fewer output samples
+void resampler_adjust(resampler_t *resampler, int ppm);
+
+/*
+    Resamples num interleaved stereo samples from in into out, returns how
+    many were written. out needs room for num * out_rate / in_rate + 2
+*/
+int resampler_run(resampler_t *resampler, const s16 *in, int num, s16 *out);
+
+#endif
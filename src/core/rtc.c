@@ -4,6 +4,7 @@
 #include "hw.h"
 #include "cpu.h"
 #include "mbc.h"
+#include "instance.h"
 
 #undef H
 
@@ -13,21 +14,18 @@
 #define DL 0x03
 #define DH 0x04
 
-rtc_t rtc;
-
-hw_event_t rtc_event;
 
 static void rtc_next_day() {
-    u16 d = rtc.ticking[DL] | ((rtc.ticking[DH] & 0x01) << 8);
+    u16 d = RTC.ticking[DL] | ((RTC.ticking[DH] & 0x01) << 8);
     d++;
     if(d >= 0x200) { // rtc day overflow
         d = 0;
-        rtc.ticking[DH] |= 0x80;
+        RTC.ticking[DH] |= 0x80;
     }
 }
 
 static inline void rtc_tick(u8 r) {
-    u8 *regs[] = {&rtc.ticking[S], &rtc.ticking[M], &rtc.ticking[H]};
+    u8 *regs[] = {&RTC.ticking[S], &RTC.ticking[M], &RTC.ticking[H]};
     switch(r) {
         case 0: case 1:
             (*regs[r])++;
@@ -49,56 +47,56 @@ static inline void rtc_tick(u8 r) {
 }
 
 static void step(int mcs) {
-    if(~rtc.ticking[DH] & 0x40) {
+    if(~RTC.ticking[DH] & 0x40) {
         rtc_tick(0);
     }
-    hw_schedule(&rtc_event, cpu.freq);
+    hw_schedule(&RTC_EVENT, CPU.freq);
 }
 
 void rtc_reset() {
-    memset(&rtc, 0x00, sizeof(rtc));
+    memset(&RTC, 0x00, sizeof(RTC));
 
-    rtc_event.callback = step;
+    RTC_EVENT.callback = step;
 
 #ifdef DEBUG
-    sprintf(rtc_event.name, "rtc");
+    sprintf(RTC_EVENT.name, "rtc");
 #endif
 }
 
 void rtc_begin() {
-    if(mbc.type == 3) {
-        hw_schedule(&rtc_event, cpu.freq);
+    if(MBC.type == 3) {
+        hw_schedule(&RTC_EVENT, CPU.freq);
     }
 }
 
 void rtc_map_register(u8 val) {
-    rtc.mapped = val - 0x08;
+    RTC.mapped = val - 0x08;
 }
 
 void rtc_latch(u8 val) {
     switch(val) {
         case 0x00:
-            rtc.prelatched = 1;
+            RTC.prelatched = 1;
         break;
         case 0x01:
-            if(rtc.prelatched) {
-                memcpy(rtc.latched, rtc.ticking, sizeof(rtc.latched));
+            if(RTC.prelatched) {
+                memcpy(RTC.latched, RTC.ticking, sizeof(RTC.latched));
             }
-            rtc.prelatched = 0;
+            RTC.prelatched = 0;
         break;
 
         default:
-            rtc.prelatched = 0;
+            RTC.prelatched = 0;
     }
 }
 
 void rtc_write(u8 val) {
-    rtc.ticking[rtc.mapped] = val;
+    RTC.ticking[RTC.mapped] = val;
 }
 
 void rtc_advance_seconds(time_t seconds) {
     time_t s;
-    if(rtc.ticking[DH] & 0x40) {
+    if(RTC.ticking[DH] & 0x40) {
         return;
     }
     for(s = 0; s < seconds; s++) {
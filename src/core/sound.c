@@ -7,22 +7,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "instance.h"
 
-typedef struct {
-    u16 l, r;
-} sample_t;
+#define BLOCK_MCS 4096 // Per block at normal speed, 1/256 second
+#define MAX_DRIFT 5000 // ppm the rate control may bend the pitch by
 
-sound_t sound;
-sqw_t sqw[2];
-sweep_t sweep;
-env_t env[3];
-wave_t wave;
-noise_t noise;
+// Bit n is set if the square wave is high at step n
+static const u8 duties[4] = {0xFE, 0xFC, 0xF0, 0xC0};
 
-hw_event_t sound_mix_event;
-hw_event_t sound_length_counters_event;
-hw_event_t sound_sweep_event;
-hw_event_t sound_envelopes_event;
 
 static inline void step_length_counter(counter_t *counter, u8 *on) {
     if(counter->length > 0) {
@@ -52,364 +44,464 @@ static void step_envelope(env_t *env, u8 *volume) {
     }
 }
 
-static sample_t sqw_mix(sqw_t *ch) {
-    sample_t r = {0,0};
-    int wavefreq;
-    int wavelen;
-    u16 amp = 0;
-
-    if(!ch->on) {
-        return r;
+static u8 sqw_amp(const sqw_t *ch) {
+    if(!ch->on || ch->freq == 0x07FF) { // Fixes CASPER e.g.
+        return 0;
     }
-    ch->cc = hw.cc - ch->cc_reset;
 
+    return (duties[ch->duty] >> ch->pos) & 0x01 ? ch->volume : 0;
+}
+
+static u8 wave_amp() {
+    u8 amp;
+
+    if(!WAVE.on || WAVE.shift == 0 || WAVE.freq == 0x07FF) {
+        return 0;
+    }
 
+    amp = WAVE.data[WAVE.pos >> 1];
+    amp = WAVE.pos & 0x01 ? amp & 0x0F : amp >> 4;
 
-    wavefreq = 131072 / (2048 - ch->freq);
-    wavelen = cpu.freq / wavefreq;
+    return amp >> (WAVE.shift - 1);
+}
 
-    if(ch->cc >= wavelen) {
-        ch->cc %= wavelen;
-        ch->cc_reset = hw.cc - ch->cc;
+static u8 noise_amp() {
+    if(!NOISE.on) {
+        return 0;
     }
 
-    if(ch->freq == 0x07FF) { // Fixes CASPER e.g.
-        return r;
+    return NOISE.lsfr & 0x0001 ? 0 : NOISE.volume;
+}
+
+// Adds the change of a channel's contribution at clock t to the bleps
+static void output(int c, u32 t) {
+    u8 l, r;
+    s32 out[2] = {0, 0};
+    u32 pos;
+    int s;
+
+    switch(c) {
+        case 0: case 1: l = SQW[c].l; r = SQW[c].r; break;
+        case 2: l = WAVE.l; r = WAVE.r; break;
+        default: l = NOISE.l; r = NOISE.r; break;
     }
 
-    switch(ch->duty) {
-        case 0x00: amp = ch->cc <= wavelen>>3 ? 0x0 : 0x1; break;
-        case 0x01: amp = ch->cc <= wavelen>>2 ? 0x0 : 0x1; break;
-        case 0x02: amp = ch->cc <= wavelen>>1 ? 0x0 : 0x1; break;
-        case 0x03: amp = ch->cc <= (wavelen>>2)*3 ? 0x0 : 0x1; break;
+    if(SOUND.on) {
+        out[0] = l ? SOUND.amp[c] * SOUND.so1_volume * 0x40 : 0;
+        out[1] = r ? SOUND.amp[c] * SOUND.so2_volume * 0x40 : 0;
     }
 
-    amp *= ch->volume;
+    pos = BLEP_POS(t) / SOUND_CLOCKS_PER_SAMPLE;
 
-    r.l = ch->l ? amp : 0;
-    r.r = ch->r ? amp : 0;
+    for(s = 0; s < 2; s++) {
+        if(out[s] != SOUND.out[c][s]) {
+            blep_add(&SOUND.blep[s], pos, out[s] - SOUND.out[c][s]);
+            SOUND.out[c][s] = out[s];
+        }
+    }
+}
 
-    return r;
+static inline void set_amp(int c, u8 amp, u32 t) {
+    if(amp != SOUND.amp[c]) {
+        SOUND.amp[c] = amp;
+        output(c, t);
+    }
 }
 
-static sample_t wave_mix() {
-    sample_t r = {0,0};
-    u16 amp;
-    int wavelen;
-    int realsam;
+// After a register write or a frame sequencer event, the levels change at once
+static void update_amps() {
+    SOUND.amp[0] = sqw_amp(&SQW[0]); output(0, SOUND.now);
+    SOUND.amp[1] = sqw_amp(&SQW[1]); output(1, SOUND.now);
+    SOUND.amp[2] = wave_amp(); output(2, SOUND.now);
+    SOUND.amp[3] = noise_amp(); output(3, SOUND.now);
+}
 
-    if(!wave.on || wave.shift == 0) {
-        return r;
-    }
-    wave.cc = hw.cc - wave.cc_reset;
-    wavelen = (cpu.freq/65536) * (2048 - wave.freq);
+static void run_sqw(int c, u32 end) {
+    sqw_t *ch = &SQW[c];
+    u32 period = (2048 - ch->freq) * 4;
 
-    if(wave.cc >= wavelen) {
-        wave.cc %= wavelen;
-        wave.cc_reset = hw.cc - wave.cc;
+    if(!ch->on || ch->freq == 0x07FF) {
+        return;
     }
-    if(wave.freq == 0x07FF) { // Fixes CASPER e.g.
-        return r;
+    if(ch->next < SOUND.now) {
+        ch->next = SOUND.now;
     }
-    realsam = (wave.cc*0x20) / wavelen;
 
-    if(realsam % 2 == 0) {
-        amp = wave.data[realsam>>1] >> 4;
-    }
-    else {
-        amp = wave.data[realsam>>1] & 0x0F;
+    for(; ch->next < end; ch->next += period) {
+        ch->pos = (ch->pos + 1) & 0x07;
+        set_amp(c, sqw_amp(ch), ch->next);
     }
-    amp >>= (wave.shift-1);
+}
+
+static void run_wave(u32 end) {
+    u32 period = (2048 - WAVE.freq) * 2;
 
-    r.l = wave.l ? amp : 0;
-    r.r = wave.r ? amp : 0;
+    if(!WAVE.on || WAVE.shift == 0 || WAVE.freq == 0x07FF) {
+        return;
+    }
+    if(WAVE.next < SOUND.now) {
+        WAVE.next = SOUND.now;
+    }
 
-    return r;
+    for(; WAVE.next < end; WAVE.next += period) {
+        WAVE.pos = (WAVE.pos + 1) & 0x1F;
+        set_amp(2, wave_amp(), WAVE.next);
+    }
 }
 
-static sample_t noise_mix() {
-    sample_t r = {0,0};
-    u32 freq;
-    u16 amp;
-    hw_cycle_t wavelen;
+static void run_noise(u32 end) {
+    u32 period = (NOISE.divr == 0 ? 8 : NOISE.divr * 16) << NOISE.shift;
+    u8 b;
 
-    if(!noise.on || noise.volume == 0) {
-        return r;
+    if(!NOISE.on || NOISE.volume == 0) {
+        return;
+    }
+    if(NOISE.next < SOUND.now) {
+        NOISE.next = SOUND.now;
     }
-    noise.cc = hw.cc - noise.cc_reset;
 
-    if(noise.divr == 0) {
-        freq = (524288 * 2) >> (noise.shift+1);
+    for(; NOISE.next < end; NOISE.next += period) {
+        b = ((NOISE.lsfr + 0x0001) & 0x03) >= 0x0002 ? 1 : 0;
+        NOISE.lsfr >>= 1;
+        NOISE.lsfr &= 0xBFFF;
+        NOISE.lsfr |= b << 14;
+        if(NOISE.width) {
+            NOISE.lsfr &= 0xFFBF;
+            NOISE.lsfr |= b << 6;
+        }
+        set_amp(3, noise_amp(), NOISE.next);
     }
-    else {
-        freq = (524288 / noise.divr) >> (noise.shift+1);
+}
+
+// Steps the channels up to cc
+static void sync(hw_cycle_t cc) {
+    u32 end;
+
+    if((s32)(cc - SOUND.cc) <= 0) {
+        return;
     }
-#ifdef DEBUG
-    assert(freq != 0);
-#endif
-    wavelen = cpu.freq / freq;
-
-    if(noise.cc >= wavelen) {
-        u8 b = ((noise.lsfr + 0x0001) & 0x03) >= 0x0002 ? 1 : 0;
-        noise.lsfr >>= 1;
-        noise.lsfr &= 0xBFFF;
-        noise.lsfr |= b << 14;
-        if(noise.width) {
-            noise.lsfr &= 0xFFBF;
-            noise.lsfr |= b << 6;
-        }
-        noise.cc %= wavelen;
-        noise.cc_reset = hw.cc - noise.cc;
+
+    end = SOUND.now + (cc - SOUND.cc) * 4 / CPU.freq_factor;
+    SOUND.cc = cc;
+
+    // TODO: Handle userdefined on/off elsewhere, sound-off shouldn't use resources
+    if(sys.sound_on) {
+        run_sqw(0, end);
+        run_sqw(1, end);
+        run_wave(end);
+        run_noise(end);
+    }
+
+    SOUND.now = end;
+}
+
+/*
+    Emulation is paced by the system's clock, the device plays by its own,
+    so the ring would slowly run dry or overflow. Instead the resampling
+    ratio is bent slightly, in proportion to how far the averaged fill
+    level is off sys.sound_buf_target
+*/
+static void control_rate(u32 fill) {
+    s32 ppm;
+
+    if(sys.sound_buf_target == 0) {
+        return;
     }
 
-    amp = noise.lsfr & 0x0001 ? 0x0 : noise.volume;
+    SOUND.fill += ((s32)(fill << 8) - SOUND.fill) / 16;
 
-    r.l = noise.l ? amp : 0;
-    r.r = noise.r ? amp : 0;
+    ppm = (s64)MAX_DRIFT * (SOUND.fill - (s32)(sys.sound_buf_target << 8)) / (s32)(sys.sound_buf_target << 8);
+    ppm = max(-MAX_DRIFT, min(ppm, MAX_DRIFT));
 
-    return r;
+    resampler_adjust(&SOUND.resampler, ppm);
 }
 
-static void mix(int mcs) {
+/*
+    Only the emulation thread writes into sys.sound_buf and the audio device
+    only reads from it, so neither needs a lock. A block's samples are
+    resampled to the device's rate, written ahead of sound_buf_end and
+    published at once. If the device doesn't keep up the newest samples are
+    dropped
+*/
+static void push(const s16 *samples, u32 num) {
+    s16 resampled[BLEP_SIZE * 2 * 2]; // Devices up to twice SOUND_RATE
+    s16 *buf = (s16*)sys.sound_buf;
+    u32 end = sys.sound_buf_end;
+    u32 space = sys.sound_buf_size - (end - __atomic_load_n(&sys.sound_buf_start, __ATOMIC_ACQUIRE));
+    u32 s;
+
+    num = resampler_run(&SOUND.resampler, samples, num, resampled);
+    samples = resampled;
+
+    num = min(num, space);
+    control_rate(sys.sound_buf_size - space + num);
+
+    for(s = 0; s < num; s++, end++) {
+        buf[(end & (sys.sound_buf_size - 1)) * 2 + 0] = samples[s*2 + 0];
+        buf[(end & (sys.sound_buf_size - 1)) * 2 + 1] = samples[s*2 + 1];
+    }
+
+    __atomic_store_n(&sys.sound_buf_end, end, __ATOMIC_RELEASE);
+}
+
+static void end_block(hw_cycle_t cc) {
+    s16 samples[BLEP_SIZE * 2];
+    u32 num, clocks;
+
+    sync(cc);
+
+    num = min(SOUND.now / SOUND_CLOCKS_PER_SAMPLE, BLEP_SIZE);
+    clocks = num * SOUND_CLOCKS_PER_SAMPLE;
+
+    blep_read(&SOUND.blep[0], &samples[0], 2, num);
+    blep_read(&SOUND.blep[1], &samples[1], 2, num);
+
     if(sys.sound_on) {
-        sys_lock_audiobuf();
-        sound_mix();
-        sys_unlock_audiobuf();
+        push(samples, num);
     }
 
-    sound.mix_threshold = (cpu.freq + sound.remainder) / sys.sound_freq;
-    sound.remainder = (cpu.freq + sound.remainder) % sys.sound_freq;
+    // Rebase the clocks onto the next block, less than a sample may be left
+    SQW[0].next = SQW[0].next > clocks ? SQW[0].next - clocks : 0;
+    SQW[1].next = SQW[1].next > clocks ? SQW[1].next - clocks : 0;
+    WAVE.next = WAVE.next > clocks ? WAVE.next - clocks : 0;
+    NOISE.next = NOISE.next > clocks ? NOISE.next - clocks : 0;
+    SOUND.now -= clocks;
+}
+
+static void mix(int mcs) {
+    end_block(HW.cc - mcs);
 
-    hw_schedule(&sound_mix_event, sound.mix_threshold - mcs);
+    hw_schedule(&SOUND_MIX_EVENT, BLOCK_MCS * CPU.freq_factor - mcs);
 }
 
 static void step_length_counters(int mcs) {
-    step_length_counter(&sqw[0].counter, &sqw[0].on);
-    step_length_counter(&sqw[1].counter, &sqw[1].on);
-    step_length_counter(&wave.counter, &wave.on);
-    step_length_counter(&noise.counter, &noise.on);
+    sync(HW.cc - mcs);
 
-    hw_schedule(&sound_length_counters_event, 4096 * cpu.freq_factor - mcs);
+    step_length_counter(&SQW[0].counter, &SQW[0].on);
+    step_length_counter(&SQW[1].counter, &SQW[1].on);
+    step_length_counter(&WAVE.counter, &WAVE.on);
+    step_length_counter(&NOISE.counter, &NOISE.on);
+    update_amps();
+
+    hw_schedule(&SOUND_LENGTH_COUNTERS_EVENT, 4096 * CPU.freq_factor - mcs);
 }
 
 static void step_sweep(int mcs) {
-    if(sweep.period != 0) {
-        sweep.tick++;
-        if(sweep.tick >= sweep.period) {
-            if(sweep.dir) {
-                sqw[0].freq -= sqw[0].freq >> sweep.shift;
+    sync(HW.cc - mcs);
+
+    if(SWEEP.period != 0) {
+        SWEEP.tick++;
+        if(SWEEP.tick >= SWEEP.period) {
+            if(SWEEP.dir) {
+                SQW[0].freq -= SQW[0].freq >> SWEEP.shift;
             }
             else {
-                sqw[0].freq += sqw[0].freq >> sweep.shift;
+                SQW[0].freq += SQW[0].freq >> SWEEP.shift;
             }
-            sqw[0].freq &= 0x07FF;
-            sweep.tick = 0;
+            SQW[0].freq &= 0x07FF;
+            SWEEP.tick = 0;
         }
     }
+    update_amps();
 
-    hw_schedule(&sound_sweep_event, 9192 * cpu.freq_factor - mcs);
+    hw_schedule(&SOUND_SWEEP_EVENT, 9192 * CPU.freq_factor - mcs);
 }
 
 static void step_envelopes(int mcs) {
-    step_envelope(&env[0], &sqw[0].volume);
-    step_envelope(&env[1], &sqw[1].volume);
-    step_envelope(&env[2], &noise.volume);
+    sync(HW.cc - mcs);
 
-    hw_schedule(&sound_envelopes_event, 18384 * cpu.freq_factor - mcs);
+    step_envelope(&ENV[0], &SQW[0].volume);
+    step_envelope(&ENV[1], &SQW[1].volume);
+    step_envelope(&ENV[2], &NOISE.volume);
+    update_amps();
+
+    hw_schedule(&SOUND_ENVELOPES_EVENT, 18384 * CPU.freq_factor - mcs);
 }
 
 void sound_init() {
-    memset(&sound, 0x00, sizeof(sound));
+    memset(&SOUND, 0x00, sizeof(SOUND));
 }
 
 void sound_close() {
 }
 
 void sound_reset() {
-    sound.on = 1;
-    sound.so1_volume = 7;
-    sound.so2_volume = 7;
-    sound.remainder = 0;
+    SOUND.on = 1;
+    SOUND.so1_volume = 7;
+    SOUND.so2_volume = 7;
 
-    memset(&sqw, 0x00, sizeof(sqw));
-    memset(&env, 0x00, sizeof(env));
-    memset(&sweep, 0x00, sizeof(sweep));
-    memset(&wave, 0x00, sizeof(wave));
-    memset(&noise, 0x00, sizeof(noise));
+    memset(&SQW, 0x00, sizeof(SQW));
+    memset(&ENV, 0x00, sizeof(ENV));
+    memset(&SWEEP, 0x00, sizeof(SWEEP));
+    memset(&WAVE, 0x00, sizeof(WAVE));
+    memset(&NOISE, 0x00, sizeof(NOISE));
 
-    noise.lsfr = 0xFFFF;
+    NOISE.lsfr = 0xFFFF;
 
-    sound_mix_event.callback = mix;
-    sound_length_counters_event.callback = step_length_counters;
-    sound_sweep_event.callback = step_sweep;
-    sound_envelopes_event.callback = step_envelopes;
+    SOUND_MIX_EVENT.callback = mix;
+    SOUND_LENGTH_COUNTERS_EVENT.callback = step_length_counters;
+    SOUND_SWEEP_EVENT.callback = step_sweep;
+    SOUND_ENVELOPES_EVENT.callback = step_envelopes;
 
 #ifdef DEBUG
-    sprintf(sound_mix_event.name, "mix");
-    sprintf(sound_length_counters_event.name, "length_counters");
-    sprintf(sound_sweep_event.name, "sweep");
-    sprintf(sound_envelopes_event.name, "envelopes");
+    sprintf(SOUND_MIX_EVENT.name, "mix");
+    sprintf(SOUND_LENGTH_COUNTERS_EVENT.name, "length_counters");
+    sprintf(SOUND_SWEEP_EVENT.name, "sweep");
+    sprintf(SOUND_ENVELOPES_EVENT.name, "envelopes");
 #endif
 }
 
 void sound_begin() {
-    sound.remainder = 0;
+    sound_resync();
 
-    hw_unschedule(&sound_mix_event);             hw_schedule(&sound_mix_event, cpu.freq / sys.sound_freq);
-    hw_unschedule(&sound_length_counters_event); hw_schedule(&sound_length_counters_event, 4096);
-    hw_unschedule(&sound_sweep_event);           hw_schedule(&sound_sweep_event, 4096);
-    hw_unschedule(&sound_envelopes_event);       hw_schedule(&sound_envelopes_event, 18384);
+    hw_unschedule(&SOUND_MIX_EVENT);             hw_schedule(&SOUND_MIX_EVENT, BLOCK_MCS * CPU.freq_factor);
+    hw_unschedule(&SOUND_LENGTH_COUNTERS_EVENT); hw_schedule(&SOUND_LENGTH_COUNTERS_EVENT, 4096);
+    hw_unschedule(&SOUND_SWEEP_EVENT);           hw_schedule(&SOUND_SWEEP_EVENT, 4096);
+    hw_unschedule(&SOUND_ENVELOPES_EVENT);       hw_schedule(&SOUND_ENVELOPES_EVENT, 18384);
 }
 
+void sound_sync() {
+    sync(HW.cc);
+}
 
-// TODO: Handle userdefined on/off elsewhere, sound-off shouldn't use resources
-void sound_mix() {
-    sample_t samples[4];
+void sound_resync() {
+    SOUND.cc = HW.cc;
+    SOUND.now = 0;
+    SOUND.fill = sys.sound_buf_target << 8;
+    resampler_init(&SOUND.resampler, SOUND_RATE, sys.sound_freq);
 
-    u16 *buf = (u16*)sys.sound_buf;
+    memset(SOUND.amp, 0x00, sizeof(SOUND.amp));
+    memset(SOUND.out, 0x00, sizeof(SOUND.out));
+    blep_clear(&SOUND.blep[0]);
+    blep_clear(&SOUND.blep[1]);
 
-    if(!sound.on) {
-        buf[sys.sound_buf_end*2 + 0] = 0x0000;
-        buf[sys.sound_buf_end*2 + 1] = 0x0000;
-    }
-    else {
-        if((sys.sound_buf_end + 1) % sys.sound_buf_size == sys.sound_buf_start) {
-#ifdef DEBUG
-            printf("WARNING: Sound-Buffer overrun!\n");
-#endif
-            sys.sound_buf_start = 0;
-            sys.sound_buf_end = 0;
-        }
-
-        samples[0] = sqw_mix(&sqw[0]);
-        samples[1] = sqw_mix(&sqw[1]);
-        samples[2] = wave_mix();
-        samples[3] = noise_mix();
-
-        buf[sys.sound_buf_end*2 + 0] = (samples[0].l + samples[1].l + samples[2].l + samples[3].l)*sound.so1_volume*0x40;
-        buf[sys.sound_buf_end*2 + 1] = (samples[0].r + samples[1].r + samples[2].r + samples[3].r)*sound.so2_volume*0x40;
-    }
-    sys.sound_buf_end++;
-    sys.sound_buf_end %= sys.sound_buf_size;
+    update_amps();
 }
 
 void sound_write(u8 sadr, u8 val) {
+    sync(HW.cc);
+
     switch(sadr) {
         case 0x10:
-            sweep.period = (val & 0x70) >> 4;
-            sweep.dir = (val & 0x08) >> 3;
-            sweep.shift = val & 0x07;
+            SWEEP.period = (val & 0x70) >> 4;
+            SWEEP.dir = (val & 0x08) >> 3;
+            SWEEP.shift = val & 0x07;
         break;
         case 0x11:
-            sqw[0].duty = val >> 6;
-            sqw[0].counter.length = val & 0x3F;
+            SQW[0].duty = val >> 6;
+            SQW[0].counter.length = val & 0x3F;
         break;
         case 0x12:
-            sqw[0].volume = val >> 4;
-            env[0].dir = (val & 0x08) >> 3;
-            env[0].sweep = val & 0x07;
+            SQW[0].volume = val >> 4;
+            ENV[0].dir = (val & 0x08) >> 3;
+            ENV[0].sweep = val & 0x07;
         break;
         case 0x13:
-            sqw[0].freq &= 0xFF00;
-            sqw[0].freq |= val;
+            SQW[0].freq &= 0xFF00;
+            SQW[0].freq |= val;
         break;
         case 0x14:
-            sqw[0].freq &= 0xF8FF;
-            sqw[0].freq |= (val&0x07)<<8;
-            sqw[0].counter.expires = val & 0x40;
+            SQW[0].freq &= 0xF8FF;
+            SQW[0].freq |= (val&0x07)<<8;
+            SQW[0].counter.expires = val & 0x40;
             if(val & 0x80) {
-                sqw[0].on = 1;
-                sqw[0].cc_reset = hw.cc;
+                SQW[0].on = 1;
+                SQW[0].pos = 0;
+                SQW[0].next = SOUND.now + (2048 - SQW[0].freq) * 4;
             }
         break;
         case 0x16:
-            sqw[1].duty = val >> 6;
-            sqw[1].counter.length = 0x40 - (val & 0x3F);
+            SQW[1].duty = val >> 6;
+            SQW[1].counter.length = 0x40 - (val & 0x3F);
         break;
         case 0x17:
-            sqw[1].volume = val >> 4;
-            env[1].dir = (val & 0x08) >> 3;
-            env[1].sweep = val & 0x07;
+            SQW[1].volume = val >> 4;
+            ENV[1].dir = (val & 0x08) >> 3;
+            ENV[1].sweep = val & 0x07;
         break;
         case 0x18:
-            sqw[1].freq &= 0xFF00;
-            sqw[1].freq |= val;
+            SQW[1].freq &= 0xFF00;
+            SQW[1].freq |= val;
         break;
         case 0x19:
-            sqw[1].freq &= 0x00FF;
-            sqw[1].freq |= (val&0x07) << 8;
-            sqw[1].counter.expires = val & 0x40;
+            SQW[1].freq &= 0x00FF;
+            SQW[1].freq |= (val&0x07) << 8;
+            SQW[1].counter.expires = val & 0x40;
             if(val & 0x80) {
-                sqw[1].on = 1;
-                sqw[1].cc_reset = hw.cc;
+                SQW[1].on = 1;
+                SQW[1].pos = 0;
+                SQW[1].next = SOUND.now + (2048 - SQW[1].freq) * 4;
             }
         break;
         case 0x1A:
-            wave.on = val;
+            WAVE.on = val;
         break;
         case 0x1B:
-            wave.counter.length = val;
+            WAVE.counter.length = val;
         break;
         case 0x1C:
-            wave.shift = (val & 0x60) >> 5;
+            WAVE.shift = (val & 0x60) >> 5;
         break;
         case 0x1D:
-            wave.freq &= 0xFF00;
-            wave.freq |= val;
+            WAVE.freq &= 0xFF00;
+            WAVE.freq |= val;
         break;
         case 0x1E:
-            wave.freq &= 0x00FF;
-            wave.freq |= (val&0x07)<<8;
-            wave.counter.expires = val & 0x40;
+            WAVE.freq &= 0x00FF;
+            WAVE.freq |= (val&0x07)<<8;
+            WAVE.counter.expires = val & 0x40;
             if(val & 0x80) {
-                wave.cc_reset = hw.cc;
+                WAVE.pos = 0;
+                WAVE.next = SOUND.now + (2048 - WAVE.freq) * 2;
             }
         break;
         case 0x20:
-            noise.counter.length = 64-(val & 0x3F);
+            NOISE.counter.length = 64-(val & 0x3F);
         break;
         case 0x21:
-            noise.volume = val >> 4;
-            env[2].dir = val & 0x08;
-            env[2].sweep = val & 0x07;
+            NOISE.volume = val >> 4;
+            ENV[2].dir = val & 0x08;
+            ENV[2].sweep = val & 0x07;
         break;
         case 0x22:
-            noise.shift = val >> 4;
-            noise.width = val & 0x08;
-            noise.divr = val & 0x07;
+            NOISE.shift = val >> 4;
+            NOISE.width = val & 0x08;
+            NOISE.divr = val & 0x07;
         break;
         case 0x23:
-            noise.counter.expires = val & 0x40;
+            NOISE.counter.expires = val & 0x40;
             if(val & 0x80) {
-                noise.on = 1;
-                noise.cc_reset = hw.cc;
-                noise.counter.length = noise.counter.length == 0 ? 0x40 : noise.counter.length;
+                NOISE.on = 1;
+                NOISE.next = SOUND.now;
+                NOISE.counter.length = NOISE.counter.length == 0 ? 0x40 : NOISE.counter.length;
             }
         break;
         case 0x24:
-            sound.so1_volume = val & 0x07;
-            sound.so2_volume = val >> 4;
+            SOUND.so1_volume = val & 0x07;
+            SOUND.so2_volume = val >> 4;
         break;
         case 0x25:
-            sqw[0].l = val & 0x01; sqw[0].r = val & 0x10;
-            sqw[1].l = val & 0x02; sqw[1].r = val & 0x20;
-            wave.l =  val & 0x04; wave.r =  val & 0x40;
-            noise.l = val & 0x08; noise.r = val & 0x80;
+            SQW[0].l = val & 0x01; SQW[0].r = val & 0x10;
+            SQW[1].l = val & 0x02; SQW[1].r = val & 0x20;
+            WAVE.l =  val & 0x04; WAVE.r =  val & 0x40;
+            NOISE.l = val & 0x08; NOISE.r = val & 0x80;
         break;
         case 0x26:
-            sound.on = val & 0x80;
+            SOUND.on = val & 0x80;
         break;
 
         case 0x30: case 0x31: case 0x32: case 0x33:
         case 0x34: case 0x35: case 0x36: case 0x37:
         case 0x38: case 0x39: case 0x3A: case 0x3B:
         case 0x3C: case 0x3D: case 0x3E: case 0x3F:
-            wave.data[sadr - 0x30] = val;
+            WAVE.data[sadr - 0x30] = val;
         break;
 
         default:
             assert(0);
     }
+
+    update_amps();
 }
 
 u8 sound_read(u8 sadr) {
@@ -417,83 +509,83 @@ u8 sound_read(u8 sadr) {
 
     switch(sadr) {
         case 0x10:
-            val = (sweep.period << 4) | (sweep.dir << 3) | sweep.shift;
+            val = (SWEEP.period << 4) | (SWEEP.dir << 3) | SWEEP.shift;
         break;
         case 0x11:
-            val = sqw[0].duty << 6;
+            val = SQW[0].duty << 6;
         break;
         case 0x12:
-            val = (sqw[0].volume << 4) || (env[0].dir << 3) | env[0].sweep;
+            val = (SQW[0].volume << 4) || (ENV[0].dir << 3) | ENV[0].sweep;
         break;
         case 0x13:
             val = 0x00;
         break;
         case 0x14:
-            val = sqw[0].counter.expires;
+            val = SQW[0].counter.expires;
         break;
         case 0x16:
-            val = sqw[1].duty << 6;
+            val = SQW[1].duty << 6;
         break;
         case 0x17:
-            val = (sqw[1].volume << 4) | (env[1].dir << 3) | env[1].sweep;
+            val = (SQW[1].volume << 4) | (ENV[1].dir << 3) | ENV[1].sweep;
         break;
         case 0x18:
             val = 0x00;
         break;
         case 0x19:
-            val = sqw[1].counter.expires;
+            val = SQW[1].counter.expires;
         break;
         case 0x1A:
-            val = wave.on;
+            val = WAVE.on;
         break;
         case 0x1B:
-            val = wave.counter.length;
+            val = WAVE.counter.length;
         break;
         case 0x1C:
-            val = wave.shift << 5;
+            val = WAVE.shift << 5;
         break;
         case 0x1D:
             val = 0x00;
         break;
         case 0x1E:
-            val = wave.counter.expires;
+            val = WAVE.counter.expires;
         break;
         case 0x20:
-            val = noise.counter.length;
+            val = NOISE.counter.length;
         break;
         case 0x21:
-            val = (noise.volume << 4) | (env[2].dir << 3) | (env[2].sweep);
+            val = (NOISE.volume << 4) | (ENV[2].dir << 3) | (ENV[2].sweep);
         break;
         case 0x22:
-            val = (noise.shift << 4) || (noise.width) | (noise.divr);
+            val = (NOISE.shift << 4) || (NOISE.width) | (NOISE.divr);
         break;
         case 0x23:
-            val = noise.counter.expires;
+            val = NOISE.counter.expires;
         break;
         case 0x24:
-            val = sound.so1_volume | (sound.so2_volume << 4);
+            val = SOUND.so1_volume | (SOUND.so2_volume << 4);
         break;
         case 0x25:
             val =
-            (sqw[0].l ? 0x01 : 0x00) | (sqw[0].r ? 0x10 : 0x00) |
-            (sqw[1].l ? 0x02 : 0x00) | (sqw[1].r ? 0x20 : 0x00) |
-            (wave.l ? 0x04 : 0x00) | (wave.r ? 0x40 : 0x00) |
-            (noise.l ? 0x08 : 0x00) | (noise.r ? 0x80 : 0x00);
+            (SQW[0].l ? 0x01 : 0x00) | (SQW[0].r ? 0x10 : 0x00) |
+            (SQW[1].l ? 0x02 : 0x00) | (SQW[1].r ? 0x20 : 0x00) |
+            (WAVE.l ? 0x04 : 0x00) | (WAVE.r ? 0x40 : 0x00) |
+            (NOISE.l ? 0x08 : 0x00) | (NOISE.r ? 0x80 : 0x00);
         break;
         case 0x26:
             val =
-            (sound.on ? 0x80 : 0x00) |
-            (noise.on ? 0x08 : 0x00) |
-            (wave.on ? 0x04 : 0x00) |
-            (sqw[1].on ? 0x02 : 0x00) |
-            (sqw[0].on ? 0x01 : 0x00);
+            (SOUND.on ? 0x80 : 0x00) |
+            (NOISE.on ? 0x08 : 0x00) |
+            (WAVE.on ? 0x04 : 0x00) |
+            (SQW[1].on ? 0x02 : 0x00) |
+            (SQW[0].on ? 0x01 : 0x00);
         break;
 
         case 0x30: case 0x31: case 0x32: case 0x33:
         case 0x34: case 0x35: case 0x36: case 0x37:
         case 0x38: case 0x39: case 0x3A: case 0x3B:
         case 0x3C: case 0x3D: case 0x3E: case 0x3F:
-            val = wave.data[sadr - 0x30];
+            val = WAVE.data[sadr - 0x30];
         break;
 
         default:
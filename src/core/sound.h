@@ -3,15 +3,34 @@
 
 #include "defines.h"
 #include "hw.h"
+#include "blep.h"
+#include "resampler.h"
+
+/*
+    Time within the sound module is counted in APU clocks (4194304 Hz) from
+    the start of the current block. Channels are stepped from one change of
+    their level to the next and each change is added to the blep buffers.
+    At the end of a block its samples are read from those at SOUND_RATE and
+    resampled to the device's rate
+*/
+
+#define SOUND_CLOCKS_PER_SAMPLE 64
+#define SOUND_RATE (4194304 / SOUND_CLOCKS_PER_SAMPLE)
 
 typedef struct {
     u8 on;
     u8 so1_volume;
     u8 so2_volume;
 
-    int mix_threshold;
-    hw_cycle_t cc_reset;
-    int remainder;
+    hw_cycle_t cc; // Synthesized up to here
+    u32 now; // APU clocks since the block began
+
+    u8 amp[4]; // Current level of each channel, 0 - 0x0F
+    s32 out[4][2]; // What each channel contributes to the left and right blep
+    blep_t blep[2];
+
+    resampler_t resampler;
+    s32 fill; // Average fill level of sys.sound_buf, 24.8 fixed point
 } sound_t;
 
 typedef struct {
@@ -31,8 +50,8 @@ typedef struct {
     u16 freq;
     u8 duty;
     u8 volume;
-    int cc;
-    hw_cycle_t cc_reset;
+    u8 pos; // Of the 8 duty steps
+    u32 next; // Clock of the next step
     counter_t counter;
 } sqw_t;
 
@@ -45,8 +64,8 @@ typedef struct {
 
 typedef struct {
     u8 on;
-    int cc;
-    hw_cycle_t cc_reset;
+    u8 pos; // Of the 32 samples
+    u32 next;
     u8 l, r;
     u16 freq;
     u8 shift;
@@ -56,8 +75,7 @@ typedef struct {
 
 typedef struct {
     u8 on;
-    int cc;
-    hw_cycle_t cc_reset;
+    u32 next;
     u8 l, r;
     u8 volume;
     u8 shift;
@@ -67,27 +85,17 @@ typedef struct {
     counter_t counter;
 } noise_t;
 
-extern sound_t sound;
-
-extern hw_event_t sound_mix_event;
-extern hw_event_t sound_length_counters_event;
-extern hw_event_t sound_sweep_event;
-extern hw_event_t sound_envelopes_event;
-
-extern sqw_t sqw[2];
-extern env_t env[3];
-extern sweep_t sweep;
-extern wave_t wave;
-extern noise_t noise;
 
 void sound_init();
 void sound_close();
 void sound_reset();
 void sound_begin();
 
-void sound_lock();
-void sound_unlock();
-void sound_mix();
+// Synthesizes up to hw.cc, e.g. before the CPU speed changes
+void sound_sync();
+
+// Drops pending samples and restarts synthesis at hw.cc, e.g. after loading a state
+void sound_resync();
 
 void sound_write(u8 sadr, u8 val);
 u8 sound_read(u8 sadr);
@@ -0,0 +1,84 @@
+#ifndef CORE_TILE_H
+#define CORE_TILE_H
+
+#include "defines.h"
+#include "lcd.h"
+
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define TILE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TILE_NEON
+#endif
+
+/*
+    Decodes all 8 pixels of a tile row from its two bitplane bytes at once.
+    A row is a u64 holding one color id per byte, the leftmost pixel in the
+    lowest byte. tile_row_lut spreads the bits of a byte that way
+*/
+
+extern const u64 tile_row_lut[256];
+
+static inline u64 tile_row(const u8 *line) {
+    return tile_row_lut[line[0]] | (tile_row_lut[line[1]] << 1);
+}
+
+static inline u64 tile_row_flipped(const u8 *line) {
+    return __builtin_bswap64(tile_row(line));
+}
+
+static inline u8 tile_row_id(u64 row, int tx) {
+    return (row >> (tx * 8)) & 0xFF;
+}
+
+// Looks up all color ids of a row in a 4 color palette
+static inline void tile_row_colors(u64 row, const u16 *palette, u16 *colors) {
+#if defined(TILE_SSE2)
+    __m128i ids = _mm_unpacklo_epi8(_mm_cvtsi64_si128(row), _mm_setzero_si128());
+    __m128i c;
+
+    c =                  _mm_and_si128(_mm_cmpeq_epi16(ids, _mm_set1_epi16(0)), _mm_set1_epi16(palette[0]));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi16(ids, _mm_set1_epi16(1)), _mm_set1_epi16(palette[1])));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi16(ids, _mm_set1_epi16(2)), _mm_set1_epi16(palette[2])));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi16(ids, _mm_set1_epi16(3)), _mm_set1_epi16(palette[3])));
+    _mm_storeu_si128((__m128i*)colors, c);
+#elif defined(TILE_NEON)
+    // Low and high bytes of the palette's colors are looked up separately
+    u64 lo = (palette[0] & 0xFF) | (palette[1] & 0xFF) << 8 | (palette[2] & 0xFF) << 16 | (u64)(palette[3] & 0xFF) << 24;
+    u64 hi = (palette[0] >> 8) | (palette[1] >> 8) << 8 | (palette[2] >> 8) << 16 | (u64)(palette[3] >> 8) << 24;
+    uint8x8x2_t c;
+
+    c.val[0] = vtbl1_u8(vcreate_u8(lo), vcreate_u8(row));
+    c.val[1] = vtbl1_u8(vcreate_u8(hi), vcreate_u8(row));
+    vst2_u8((u8*)colors, c);
+#else
+    int tx;
+
+    for(tx = 0; tx < 8; tx++) {
+        colors[tx] = palette[tile_row_id(row, tx)];
+    }
+#endif
+}
+
+static inline void tile_row_meta(u64 row, u8 priority, pixel_meta_t *meta) {
+#if defined(TILE_SSE2)
+    __m128i m = _mm_unpacklo_epi8(_mm_cvtsi64_si128(row), _mm_set1_epi8(priority));
+    _mm_storeu_si128((__m128i*)meta, m);
+#elif defined(TILE_NEON)
+    uint8x8x2_t m;
+
+    m.val[0] = vcreate_u8(row);
+    m.val[1] = vdup_n_u8(priority);
+    vst2_u8((u8*)meta, m);
+#else
+    int tx;
+
+    for(tx = 0; tx < 8; tx++) {
+        meta[tx].color_id = tile_row_id(row, tx);
+        meta[tx].priority = priority;
+    }
+#endif
+}
+
+#endif
@@ -3,78 +3,75 @@
 #include "defines.h"
 #include "cpu.h"
 #include <stdio.h>
+#include "instance.h"
 
 #define MCS_PER_DIVT 32
 
-timers_t timers;
 
 static const u16 MCS_PER_TIMA[4] = {0x100, 0x04, 0x10, 0x40};
 
-hw_event_t timers_div_event;
-hw_event_t timers_tima_event;
-
 
 static void div_step(int mcs) {
-    timers.div++;
-    hw_schedule(&timers_div_event, MCS_PER_DIVT - mcs);
+    TIMERS.div++;
+    hw_schedule(&TIMERS_DIV_EVENT, MCS_PER_DIVT - mcs);
 }
 
 static void timer_step(int mcs) {
     for(;;) {
-        timers.tima++;
-        if(timers.tima == 0x00) {
-            cpu.irq |= IF_TIMER;
-            timers.tima = timers.tma;
+        TIMERS.tima++;
+        if(TIMERS.tima == 0x00) {
+            CPU.irq |= IF_TIMER;
+            TIMERS.tima = TIMERS.tma;
         }
 
-        if(mcs >= MCS_PER_TIMA[timers.tac & 0x03])
-            mcs -= MCS_PER_TIMA[timers.tac & 0x03];
+        if(mcs >= MCS_PER_TIMA[TIMERS.tac & 0x03])
+            mcs -= MCS_PER_TIMA[TIMERS.tac & 0x03];
         else
             break;
     }
-    hw_schedule(&timers_tima_event, MCS_PER_TIMA[timers.tac & 0x03] - mcs);
+    hw_schedule(&TIMERS_TIMA_EVENT, MCS_PER_TIMA[TIMERS.tac & 0x03] - mcs);
 }
 
 void timers_reset() {
-    timers.div = 0x00;
-    timers.tima = 0x00;
-    timers.tma = 0x00;
-    timers.tac = 0x00;
-    timers.div_cc = 0;
-    timers.tima_cc = 0;
+    TIMERS.div = 0x00;
+    TIMERS.tima = 0x00;
+    TIMERS.tma = 0x00;
+    TIMERS.tac = 0x00;
+    TIMERS.div_cc = 0;
+    TIMERS.tima_cc = 0;
 
-    timers_div_event.callback = div_step;
-    timers_tima_event.callback = timer_step;
+    TIMERS_DIV_EVENT.callback = div_step;
+    TIMERS_TIMA_EVENT.callback = timer_step;
 
 #ifdef DEBUG
-    sprintf(timers_div_event.name, "div");
-    sprintf(timers_tima_event.name, "tima");
+    sprintf(TIMERS_DIV_EVENT.name, "div");
+    sprintf(TIMERS_TIMA_EVENT.name, "tima");
 #endif
 }
 
 void timers_begin() {
-    hw_unschedule(&timers_tima_event);
-    hw_unschedule(&timers_div_event);
+    hw_unschedule(&TIMERS_TIMA_EVENT);
+    hw_unschedule(&TIMERS_DIV_EVENT);
 
-    hw_schedule(&timers_div_event, MCS_PER_DIVT);
+    hw_schedule(&TIMERS_DIV_EVENT, MCS_PER_DIVT);
 }
 
 void timers_tac(u8 tac) {
-    if((timers.tac & 0x04) && !(tac & 0x04)) {
-        hw_unschedule(&timers_tima_event);
+    if((TIMERS.tac & 0x04) && !(tac & 0x04)) {
+        hw_unschedule(&TIMERS_TIMA_EVENT);
     }
-    else if(!(timers.tac & 0x04) && (tac & 0x04)) {
-        hw_unschedule(&timers_tima_event);
-        hw_schedule(&timers_tima_event, MCS_PER_TIMA[timers.tac & 0x03]);
+    else if(!(TIMERS.tac & 0x04) && (tac & 0x04)) {
+        hw_unschedule(&TIMERS_TIMA_EVENT);
+        hw_schedule(&TIMERS_TIMA_EVENT, MCS_PER_TIMA[TIMERS.tac & 0x03]);
     }
 
-    if((timers.tac & 0x03) != (tac & 0x03)) {
-        hw_unschedule(&timers_tima_event);
+    if((TIMERS.tac & 0x03) != (tac & 0x03)) {
+        hw_unschedule(&TIMERS_TIMA_EVENT);
         if(tac & 0x04) {
-            hw_schedule(&timers_tima_event, MCS_PER_TIMA[tac & 0x03]);
+            hw_schedule(&TIMERS_TIMA_EVENT, MCS_PER_TIMA[tac & 0x03]);
         }
     }
 
-    timers.tac = tac&0x07;
+    TIMERS.tac = tac&0x07;
 }
 
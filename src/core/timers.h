@@ -12,11 +12,6 @@ typedef struct {
     u32 div_cc, tima_cc;
 } timers_t;
 
-extern timers_t timers;
-
-extern hw_event_t timers_div_event;
-extern hw_event_t timers_tima_event;
-
 
 void timers_reset();
 void timers_begin();
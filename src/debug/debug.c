@@ -14,6 +14,7 @@
 #include "disasm.h"
 #include "record.h"
 #include "watch.h"
+#include "core/instance.h"
 
 typedef enum {
     DEBUG_RUN,
@@ -8,6 +8,7 @@
 #include "core/mem.h"
 
 #include "debug.h"
+#include "core/instance.h"
 
 static char out_disasm_str[256] = { '\0' };
 static u16 pc;
@@ -389,7 +390,7 @@ static void build_rmn(OP op, REG r, u8 n) {
 
 
 static void build_cb(u8 cb) {
-    switch(cpu.cb) {
+    switch(CPU.cb) {
         CB_OP_CASES_NOARG(0x00, OP_RLC);
         CB_OP_CASES_NOARG(0x08, OP_RRC);
         CB_OP_CASES_NOARG(0x10, OP_RL);
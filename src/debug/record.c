@@ -6,6 +6,7 @@
 #include "core/cpu.h"
 
 #include "disasm.h"
+#include "core/instance.h"
 
 typedef struct {
     u16 pc;
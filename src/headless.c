@@ -0,0 +1,756 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/moo.h"
+#include "core/lcd.h"
+#include "core/load.h"
+#include "core/instance.h"
+#include "sys/sys.h"
+#include "util/pathes.h"
+#include "util/pool.h"
+#include "util/framerate.h"
+#include "util/performance.h"
+#include "util/speed.h"
+#include "core/tile.h"
+#include "core/maps.h"
+#include "util/scaler.h"
+#include "core/ints.h"
+#include "core/ops_bench.h"
+
+/*
+    Runs a ROM for a fixed number of frames or cycles as fast as the core
+    permits and reports the throughput as well as a checksum of the last
+    complete frame, so regression farms can compare runs.
+    With --instances and --threads the ROM runs several times side by side
+    on a thread pool, stepped frame by frame in lockstep, and the aggregate
+    throughput is reported.
+    With --frameskip N only every (N+1)th frame is drawn, the checksum is
+    taken from the last drawn one. --render-thread draws the lines of each
+    instance on a thread of its own.
+    --bench-tiles needs no ROM, it measures how fast tile rows are decoded.
+    --bench-maps neither, it measures the cost of composing background lines.
+    --bench-scaler compares the scaling kernels to the generic path for
+    16 and 32 bit pixel formats.
+    --bench-sched measures the cost of stepping and rescheduling hw events.
+    --bench-dispatch runs the same instructions with switch and threaded
+    dispatch (GCC or Clang, not in Debug builds) and reports ns per op.
+*/
+
+typedef struct {
+    const char *rom;
+    unsigned long frames;
+    unsigned long long cycles;
+    int dmg;
+    int frameskip;
+    int instances;
+    int threads;
+    int pin;
+    int render_thread;
+    int bench_tiles;
+    int bench_maps;
+    int bench_scaler;
+    int bench_sched;
+    int bench_dispatch;
+} options_t;
+
+static options_t options;
+
+static void usage(const char *exec) {
+    fprintf(stderr, "Usage: %s [--frames N] [--cycles N] [--dmg] [--frameskip N] [--instances N] [--threads N] [--pin] [--render-thread] <rom>\n"
+                    "       %s --bench-tiles\n"
+                    "       %s --bench-maps\n"
+                    "       %s --bench-scaler\n"
+                    "       %s --bench-sched\n"
+                    "       %s --bench-dispatch\n", exec, exec, exec, exec, exec, exec);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_args(int argc, const char **argv) {
+    int a;
+
+    options.rom = NULL;
+    options.frames = 0;
+    options.cycles = 0;
+    options.dmg = 0;
+    options.frameskip = 0;
+    options.instances = 1;
+    options.threads = 0;
+    options.pin = 0;
+    options.render_thread = 0;
+    options.bench_tiles = 0;
+    options.bench_maps = 0;
+    options.bench_scaler = 0;
+    options.bench_sched = 0;
+    options.bench_dispatch = 0;
+
+    for(a = 1; a < argc; a++) {
+        if(strcmp(argv[a], "--frames") == 0 && a + 1 < argc) {
+            options.frames = strtoul(argv[++a], NULL, 10);
+        }
+        else if(strcmp(argv[a], "--cycles") == 0 && a + 1 < argc) {
+            options.cycles = strtoull(argv[++a], NULL, 10);
+        }
+        else if(strcmp(argv[a], "--dmg") == 0) {
+            options.dmg = 1;
+        }
+        else if(strcmp(argv[a], "--frameskip") == 0 && a + 1 < argc) {
+            options.frameskip = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--instances") == 0 && a + 1 < argc) {
+            options.instances = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+            options.threads = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--pin") == 0) {
+            options.pin = 1;
+        }
+        else if(strcmp(argv[a], "--render-thread") == 0) {
+            options.render_thread = 1;
+        }
+        else if(strcmp(argv[a], "--bench-tiles") == 0) {
+            options.bench_tiles = 1;
+        }
+        else if(strcmp(argv[a], "--bench-maps") == 0) {
+            options.bench_maps = 1;
+        }
+        else if(strcmp(argv[a], "--bench-scaler") == 0) {
+            options.bench_scaler = 1;
+        }
+        else if(strcmp(argv[a], "--bench-sched") == 0) {
+            options.bench_sched = 1;
+        }
+        else if(strcmp(argv[a], "--bench-dispatch") == 0) {
+            options.bench_dispatch = 1;
+        }
+        else if(argv[a][0] != '-' && options.rom == NULL) {
+            options.rom = argv[a];
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+
+    if(options.bench_tiles || options.bench_maps || options.bench_scaler || options.bench_sched || options.bench_dispatch) {
+        return;
+    }
+    if(options.rom == NULL || options.instances < 1) {
+        usage(argv[0]);
+    }
+    if(options.frames == 0 && options.cycles == 0) {
+        options.frames = 60;
+    }
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static u32 fb_checksum() {
+    u32 hash = 0x811C9DC5;
+    const u8 *byte = (const u8*)LCD.clean_fb;
+    size_t b;
+
+    for(b = 0; b < LCD_WIDTH * LCD_HEIGHT * sizeof(*LCD.clean_fb); b++) {
+        hash ^= byte[b];
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+static int load(const char *path) {
+    moo_init();
+    if(options.dmg) {
+        moo_set_hw(DMG_HW);
+    }
+
+    pathes_rompath(path);
+
+    moo_reset();
+    load_rom();
+
+    if(~MOO.state & MOO_ROM_LOADED_BIT) {
+        return 0;
+    }
+
+    moo_begin();
+    return 1;
+}
+
+/*
+    Colors random tile rows pixel by pixel, the way the renderer used to,
+    and row-wise through tile.h, makes sure both agree and reports the
+    pixels per second of each
+*/
+static int bench_tiles() {
+    enum { ROWS = 4096, PASSES = 1000 };
+    static const u16 palette[4] = {0x7FFF, 0x4E73, 0x1CE7, 0x0000};
+    static u8 lines[ROWS][2];
+    static u16 expected[ROWS][8], actual[ROWS][8];
+    double begin, per_pixel, row_wise;
+    int p, r, tx;
+
+#if defined(TILE_SSE2)
+    const char *path = "SSE2";
+#elif defined(TILE_NEON)
+    const char *path = "NEON";
+#else
+    const char *path = "scalar";
+#endif
+
+    for(r = 0; r < ROWS; r++) {
+        lines[r][0] = rand();
+        lines[r][1] = rand();
+    }
+
+    begin = now_ms();
+    for(p = 0; p < PASSES; p++) {
+        for(r = 0; r < ROWS; r++) {
+            for(tx = 0; tx < 8; tx++) {
+                u8 lsb = (lines[r][0] >> (7 - tx)) & 0x01;
+                u8 msb = (lines[r][1] >> (7 - tx)) & 0x01;
+                expected[r][tx] = palette[lsb | (msb << 1)];
+            }
+        }
+    }
+    per_pixel = now_ms() - begin;
+
+    begin = now_ms();
+    for(p = 0; p < PASSES; p++) {
+        for(r = 0; r < ROWS; r++) {
+            tile_row_colors(tile_row(lines[r]), palette, actual[r]);
+        }
+    }
+    row_wise = now_ms() - begin;
+
+    if(memcmp(expected, actual, sizeof(expected)) != 0) {
+        fprintf(stderr, "Row-wise tile decoding differs from decoding pixel by pixel\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Per pixel: %.1f Mpixels/s\n", ROWS * 8.0 * PASSES / (per_pixel * 1000.0));
+    printf("Row-wise (%s): %.1f Mpixels/s\n", path, ROWS * 8.0 * PASSES / (row_wise * 1000.0));
+
+    return EXIT_SUCCESS;
+}
+
+/*
+    Scrolls diagonally over random maps and tiles and streams in a new map
+    column and a few tiles every frame, like scrolling games do. Reports
+    the time spent in lcd_scan_maps() per line, build with and without
+    MOOBOY_PACKED_MAPS to compare both background layouts
+*/
+static int bench_maps() {
+    enum { FRAMES = 20000, STREAMED_TILES = 4 };
+    static u16 scan[LCD_WIDTH];
+    static pixel_meta_t meta[LCD_WIDTH];
+    moo_instance_t *instance = moo_instance_create();
+    double begin, elapsed;
+    u32 checksum = 0;
+    int f, b, i;
+
+    moo_instance_select(instance);
+    moo_init();
+    moo_reset();
+
+    for(b = 0; b < 2; b++) {
+        RAM.selected_vrambank = b;
+        for(i = 0; i < 0x2000; i++) {
+            lcd_vram_write(0x8000 + i, rand());
+        }
+    }
+    lcd_palette_control(&LCD.bgp, 0x80);
+    for(i = 0; i < 0x40; i++) {
+        lcd_cgb_palette_data(&LCD.bgp, rand());
+    }
+    LCD.c = LCDC_DISPLAY_ENABLE_BIT | LCDC_WND_ENABLE_BIT | LCDC_BG_ENABLE_BIT;
+    LCD.wx = 7 + 120;
+    LCD.wy = 100;
+    maps_dirty();
+
+    begin = now_ms();
+    for(f = 0; f < FRAMES; f++) {
+        LCD.scx++;
+        LCD.scy++;
+
+        for(b = 0; b < 2; b++) {
+            RAM.selected_vrambank = b;
+            for(i = 0; i < 32; i++) {
+                lcd_vram_write(0x9800 + i*32 + (LCD.scx/8 + 21) % 32, rand());
+            }
+            for(i = 0; i < STREAMED_TILES * 16; i++) {
+                lcd_vram_write(0x8800 + (f % 64) * STREAMED_TILES * 16 + i, rand());
+            }
+        }
+
+        for(LCD.ly = 0; LCD.ly < LCD_HEIGHT; LCD.ly++) {
+            lcd_scan_maps(scan, meta);
+            for(i = 0; i < LCD_WIDTH; i++) {
+                checksum = checksum * 31 + scan[i] + meta[i].color_id + meta[i].priority;
+            }
+        }
+    }
+    elapsed = now_ms() - begin;
+
+    printf("%.1f ns per line (%s), checksum %.8X\n", elapsed * 1000000.0 / (FRAMES * LCD_HEIGHT),
+#ifdef PACKED_MAPS
+           "packed maps",
+#else
+           "map caches",
+#endif
+           checksum);
+
+    moo_close();
+    moo_instance_destroy(instance);
+
+    return EXIT_SUCCESS;
+}
+
+static u32 reference_pixel(const scaler_format_t *f, u16 color) {
+    u32 r = color & 0x1F, g = (color >> 5) & 0x1F, b = (color >> 10) & 0x1F;
+
+    r = (r << 3 | r >> 2) >> f->rloss;
+    g = (g << 3 | g >> 2) >> f->gloss;
+    b = (b << 3 | b >> 2) >> f->bloss;
+
+    return r << f->rshift | g << f->gshift | b << f->bshift | f->alpha;
+}
+
+/*
+    Converts a random frame to RGB565, XRGB8888 and RGBA8888 and scales it
+    to the integer factors and a few screen sizes, once with the kernel for
+    the factor and once through the column table every other width uses
+*/
+static int bench_scaler() {
+    enum { FRAMES = 200 };
+    static const struct {
+        const char *name;
+        scaler_format_t format;
+    } formats[] = {
+        {"RGB565", {2, 11, 5, 0, 3, 2, 3, 0}},
+        {"XRGB8888", {4, 16, 8, 0, 0, 0, 0, 0}},
+        {"RGBA8888", {4, 24, 16, 8, 0, 0, 0, 0xFF}}
+    };
+    static const int sizes[][2] = {
+        {160, 144}, {320, 288}, {480, 432}, {640, 576}, {800, 720}, {960, 864}, {533, 480}, {800, 480}
+    };
+    static u16 fb[LCD_WIDTH * LCD_HEIGHT];
+    scaler_t scaler = {{0}};
+    const scaler_format_t *format;
+    u8 *kernel_pixels, *table_pixels;
+    double begin, kernel, table;
+    int m, s, f, i, pitch, factor;
+    u32 pixel;
+
+    for(i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        fb[i] = rand() & 0x7FFF;
+    }
+
+    for(m = 0; m < sizeof(formats) / sizeof(*formats); m++) {
+        format = &formats[m].format;
+        scaler_set_format(&scaler, format);
+
+        for(s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+            pitch = sizes[s][0] * format->bytes_per_pixel;
+            kernel_pixels = calloc(sizes[s][1], pitch);
+            table_pixels = calloc(sizes[s][1], pitch);
+
+            scaler_init(&scaler, sizes[s][0], sizes[s][1]);
+            factor = scaler.factor;
+
+            begin = now_ms();
+            for(f = 0; f < FRAMES; f++) {
+                scaler_run(&scaler, fb, kernel_pixels, pitch);
+            }
+            kernel = now_ms() - begin;
+
+            scaler.factor = 0;
+            begin = now_ms();
+            for(f = 0; f < FRAMES; f++) {
+                scaler_run(&scaler, fb, table_pixels, pitch);
+            }
+            table = now_ms() - begin;
+
+            if(memcmp(kernel_pixels, table_pixels, sizes[s][1] * pitch) != 0) {
+                fprintf(stderr, "%s %ix%i: The %ix kernel differs from the column table\n", formats[m].name, sizes[s][0], sizes[s][1], factor);
+                return EXIT_FAILURE;
+            }
+            for(i = 0; factor == 1 && i < LCD_WIDTH * LCD_HEIGHT; i++) {
+                pixel = format->bytes_per_pixel == 2 ? ((u16*)kernel_pixels)[i] : ((u32*)kernel_pixels)[i];
+                if(pixel != reference_pixel(format, fb[i])) {
+                    fprintf(stderr, "%s: Color %.4X converted to %.8X instead of %.8X\n", formats[m].name, fb[i], pixel, reference_pixel(format, fb[i]));
+                    return EXIT_FAILURE;
+                }
+            }
+
+            if(factor != 0) {
+                printf("%s %ix%i: %ix kernel %.3f ms/frame, column table %.3f ms/frame\n", formats[m].name, sizes[s][0], sizes[s][1], factor, kernel / FRAMES, table / FRAMES);
+            }
+            else {
+                printf("%s %ix%i: column table %.3f ms/frame\n", formats[m].name, sizes[s][0], sizes[s][1], table / FRAMES);
+            }
+
+            free(kernel_pixels);
+            free(table_pixels);
+        }
+    }
+
+    scaler_close(&scaler);
+
+    return EXIT_SUCCESS;
+}
+
+static void step(pool_t *pool) {
+    if(pool == NULL) {
+        moo_cycle(sys.quantum_length);
+    }
+    else if(options.frames != 0) {
+        pool_run_frames(pool, 1);
+    }
+    else {
+        pool_cycle(pool, sys.quantum_length);
+    }
+}
+
+/*
+    Runs the scheduler alone with the events a game typically has pending:
+    a chain of the LCD's mode events, DIV, TIMA at 16 mcs, the sound
+    sequencer and the RTC. It is stepped by 0 to 3 mcs like memory accesses
+    are, once with only the far away sound and RTC events pending, once with
+    all of them. Also reports an unschedule + schedule of TIMA among all
+    events followed by a step that fires nothing, which is what a write to
+    TAC costs
+*/
+enum { SCHED_EVENTS = 9, SCHED_NEAR_EVENTS = 5 };
+static hw_event_t sched_events[SCHED_EVENTS];
+static const int sched_periods[SCHED_EVENTS] = {20, 43, 51, 64, 16, 4096, 9192, 18384, 1048576};
+static unsigned long sched_fired;
+
+// The mode events schedule each other, the others only themselves
+#define SCHED_CALLBACK(n, next) \
+    static void sched_fire_##n(int mcs) { \
+        sched_fired++; \
+        hw_schedule(&sched_events[next], sched_periods[next] - mcs); \
+    }
+SCHED_CALLBACK(0, 1) SCHED_CALLBACK(1, 2) SCHED_CALLBACK(2, 0)
+SCHED_CALLBACK(3, 3) SCHED_CALLBACK(4, 4) SCHED_CALLBACK(5, 5)
+SCHED_CALLBACK(6, 6) SCHED_CALLBACK(7, 7) SCHED_CALLBACK(8, 8)
+
+static double bench_sched_steps(const u8 *steps, int num) {
+    double begin = now_ms();
+    int s;
+
+    for(s = 0; s < num; s++) {
+        hw_step(steps[s & 4095]);
+    }
+
+    return (now_ms() - begin) * 1e6 / num;
+}
+
+static int bench_sched() {
+    enum { STEPS = 100000000, PAIRS = 20000000 };
+    static void (* const callbacks[SCHED_EVENTS])(int) = {
+        sched_fire_0, sched_fire_1, sched_fire_2, sched_fire_3, sched_fire_4,
+        sched_fire_5, sched_fire_6, sched_fire_7, sched_fire_8
+    };
+    static u8 steps[4096];
+    moo_instance_t *instance = moo_instance_create();
+    double begin, idle, busy, pairs;
+    int s, e;
+
+    moo_instance_select(instance);
+    hw_reset();
+
+    for(s = 0; s < 4096; s++) {
+        steps[s] = rand() % 4;
+    }
+    for(e = 0; e < SCHED_EVENTS; e++) {
+        sched_events[e].callback = callbacks[e];
+    }
+
+    for(e = SCHED_NEAR_EVENTS; e < SCHED_EVENTS; e++) {
+        hw_schedule(&sched_events[e], sched_periods[e]);
+    }
+    idle = bench_sched_steps(steps, STEPS / 100);
+
+    hw_schedule(&sched_events[0], sched_periods[0]);
+    hw_schedule(&sched_events[3], sched_periods[3]);
+    hw_schedule(&sched_events[4], sched_periods[4]);
+    busy = bench_sched_steps(steps, STEPS);
+
+    begin = now_ms();
+    for(s = 0; s < PAIRS; s++) {
+        hw_unschedule(&sched_events[4]);
+        hw_schedule(&sched_events[4], sched_periods[4]);
+        hw_step(0);
+    }
+    pairs = (now_ms() - begin) * 1e6 / PAIRS;
+
+    printf("Step, nothing due: %.2f ns\n", idle);
+    printf("Step, events due: %.2f ns (%lu events fired)\n", busy, sched_fired);
+    printf("Unschedule + schedule + step: %.2f ns\n", pairs);
+
+    moo_instance_destroy(instance);
+
+    return EXIT_SUCCESS;
+}
+
+#ifdef BENCH_DISPATCH
+/*
+    A loop of loads, ALU and CB ops, stack accesses and a call, the mix a
+    game's logic runs, in a ROM of its own. No events are scheduled, so
+    beyond the hw_step() after each instruction only the dispatch is timed
+*/
+static const u8 dispatch_loop[] = {
+    0x2A,             // ld a, (hl+)
+    0x80,             // add a, b
+    0x47,             // ld b, a
+    0xA9,             // xor c
+    0x4F,             // ld c, a
+    0x1C,             // inc e
+    0x7B,             // ld a, e
+    0xE6, 0x3F,       // and 0x3f
+    0xFE, 0x20,       // cp 0x20
+    0x38, 0x01,       // jr c, +1
+    0x15,             // dec d
+    0xE0, 0x80,       // ldh (0x80), a
+    0xF0, 0x81,       // ldh a, (0x81)
+    0x07,             // rlca
+    0xC5,             // push bc
+    0xCD, 0x80, 0x01, // call 0x0180
+    0xC1,             // pop bc
+    0xCB, 0x7C,       // bit 7, h
+    0x7D,             // ld a, l
+    0xE6, 0x7F,       // and 0x7f
+    0x6F,             // ld l, a
+    0xFA, 0x00, 0xC1, // ld a, (0xc100)
+    0x3C,             // inc a
+    0xEA, 0x00, 0xC1, // ld (0xc100), a
+    0xC3, 0x00, 0x01  // jp 0x0100
+};
+static const u8 dispatch_sub[] = {
+    0xCB, 0x37,       // swap a
+    0xCB, 0x3F,       // srl a
+    0xB3,             // or e
+    0xC9              // ret
+};
+
+typedef struct {
+    u16 af, bc, de, hl, sp, pc;
+    hw_cycle_t cc;
+} dispatch_state_t;
+
+static void dispatch_restart() {
+    cpu_reset();
+    hw_reset();
+    memset(RAM.rambanks, 0x00, sizeof(RAM.rambanks));
+    memset(RAM.hram, 0x00, sizeof(RAM.hram));
+
+    PC = 0x0100;
+    SP = 0xDFFE;
+    HL = 0xC000;
+}
+
+static void dispatch_snapshot(dispatch_state_t *s) {
+    s->af = AF; s->bc = BC; s->de = DE; s->hl = HL; s->sp = SP; s->pc = PC;
+    s->cc = HW.cc;
+}
+
+static int bench_dispatch() {
+    enum { OPS = 20000000, ROUNDS = 5 };
+    moo_instance_t *instance = moo_instance_create();
+    dispatch_state_t switched, threaded;
+    double begin, switch_ns = 0.0, threaded_ns = 0.0, ns;
+    int r, executed;
+
+    moo_instance_select(instance);
+    moo_init();
+    moo_reset();
+
+    CARD.romsize = 2;
+    CARD.rombanks = calloc(CARD.romsize, sizeof(*CARD.rombanks));
+    memcpy(&CARD.rombanks[0][0x0100], dispatch_loop, sizeof(dispatch_loop));
+    memcpy(&CARD.rombanks[0][0x0180], dispatch_sub, sizeof(dispatch_sub));
+    MBC.rombank = CARD.rombanks[1];
+    mem_update_pages();
+
+    // Alternates between both and keeps the best round of each
+    for(r = 0; r < ROUNDS; r++) {
+        dispatch_restart();
+        begin = now_ms();
+        for(executed = 0; executed < OPS; executed++) {
+            ints_handle();
+            hw_step(ops_switch_exec());
+        }
+        ns = (now_ms() - begin) * 1e6 / OPS;
+        switch_ns = r == 0 ? ns : min(switch_ns, ns);
+#ifdef LAZY_FLAGS
+        ops_switch_sync_flags();
+#endif
+        dispatch_snapshot(&switched);
+
+        dispatch_restart();
+        begin = now_ms();
+        for(executed = 0; executed < OPS;) {
+            executed += ops_threaded_run(OPS - executed);
+        }
+        ns = (now_ms() - begin) * 1e6 / OPS;
+        threaded_ns = r == 0 ? ns : min(threaded_ns, ns);
+#ifdef LAZY_FLAGS
+        ops_threaded_sync_flags();
+#endif
+        dispatch_snapshot(&threaded);
+    }
+
+    printf("Switch: %.2f ns per op\n", switch_ns);
+    printf("Threaded: %.2f ns per op\n", threaded_ns);
+
+    moo_close();
+    moo_instance_destroy(instance);
+
+    if(memcmp(&switched, &threaded, sizeof(switched)) != 0) {
+        fprintf(stderr, "Both dispatches ended in different states\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+#endif
+
+int main(int argc, const char **argv) {
+    unsigned long frames = 0;
+    unsigned long long cycles = 0;
+    double begin, end;
+    moo_instance_t **instances;
+    pool_t *pool = NULL;
+    u32 checksum = 0;
+    int i, result = EXIT_SUCCESS;
+
+    parse_args(argc, argv);
+
+    if(options.bench_tiles) {
+        return bench_tiles();
+    }
+    if(options.bench_maps) {
+        return bench_maps();
+    }
+    if(options.bench_scaler) {
+        return bench_scaler();
+    }
+    if(options.bench_sched) {
+        return bench_sched();
+    }
+    if(options.bench_dispatch) {
+#ifdef BENCH_DISPATCH
+        return bench_dispatch();
+#else
+        fprintf(stderr, "Built without both dispatches side by side\n");
+        return EXIT_FAILURE;
+#endif
+    }
+#ifndef RENDER_THREAD
+    if(options.render_thread) {
+        fprintf(stderr, "Built without the render thread\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    // Shared by all instances, so reset once here instead of by moo_reset()
+    sys_init(argc, argv);
+    sys_reset();
+    performance_reset();
+    framerate_reset();
+    speed_reset();
+    framerate.frameskip = options.frameskip;
+
+    instances = calloc(options.instances, sizeof(*instances));
+    for(i = 0; i < options.instances; i++) {
+        instances[i] = moo_instance_create();
+        moo_instance_select(instances[i]);
+
+        if(!load(options.rom)) {
+            fprintf(stderr, "Failed to load ROM '%s'\n", options.rom);
+            return EXIT_FAILURE;
+        }
+        if(options.render_thread) {
+            render_enable();
+        }
+    }
+
+    if(options.instances > 1 || options.threads > 0) {
+        if(options.threads <= 0) {
+            options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        pool = pool_create(options.threads, options.pin);
+        for(i = 0; i < options.instances; i++) {
+            pool_add(pool, instances[i], POOL_ANY_WORKER);
+        }
+    }
+
+    // Only stepping counts, not loading the ROMs
+    begin = now_ms();
+
+    // All instances run the same ROM in lockstep, so the first one keeps count
+    moo_instance_select(instances[0]);
+    while((~MOO.state & MOO_ERROR_BIT) &&
+          (options.frames == 0 || frames < options.frames) &&
+          (options.cycles == 0 || cycles < options.cycles))
+    {
+        step(pool);
+        moo_instance_select(instances[0]);
+
+        cycles += HW.invoke_cc;
+        frames = LCD.frames;
+    }
+
+    end = now_ms();
+
+    for(i = 0; i < options.instances; i++) {
+        moo_instance_select(instances[i]);
+
+        if(MOO.state & MOO_ERROR_BIT) {
+            fprintf(stderr, "Emulation stopped: %s\n", MOO.error != NULL ? MOO.error->text : "Unknown error");
+            return EXIT_FAILURE;
+        }
+        if(i == 0) {
+            checksum = fb_checksum();
+        }
+        else if(fb_checksum() != checksum) {
+            fprintf(stderr, "Framebuffer checksum of instance %i differs\n", i);
+            result = EXIT_FAILURE;
+        }
+    }
+
+    frames *= options.instances;
+    cycles *= options.instances;
+
+    if(pool != NULL) {
+        printf("Ran %i instances on %i threads\n", options.instances, options.threads);
+    }
+    printf("Ran %lu frames (%llu cycles) in %.3f ms, %.1f frames/s, %.1f%% speed\n",
+           frames, cycles, end - begin,
+           frames * 1000.0 / (end - begin),
+           frames * 100000.0 / (LCD_FRAMERATE * (end - begin)));
+    printf("Framebuffer checksum %.8X\n", checksum);
+
+    if(pool != NULL) {
+        pool_destroy(pool);
+    }
+
+    moo_instance_select(instances[0]);
+    moo_close();
+    sys_close();
+
+    for(i = 0; i < options.instances; i++) {
+        moo_instance_destroy(instances[i]);
+    }
+    free(instances);
+
+    return result;
+}
@@ -0,0 +1,30 @@
+#include "menu/menu.h"
+#include <stdio.h>
+#include "core/moo.h"
+#include "core/instance.h"
+
+/*
+    There's no one to ask in headless mode, so every dialog takes the
+    conservative answer and errors end the run.
+*/
+
+void menu_init() {
+}
+
+void menu_close() {
+}
+
+void menu_run() {
+    MOO.state &= ~MOO_RUNNING_BIT;
+}
+
+void menu_error() {
+    fprintf(stderr, "%s\n", MOO.error != NULL ? MOO.error->text : "Unknown error");
+    MOO.state &= ~MOO_RUNNING_BIT;
+}
+
+void menu_continue() {
+}
+
+void menu_warn_rtc_sav_conflict() {
+}
@@ -5,6 +5,7 @@
 #include "core/moo.h"
 #include "sys/sdl/input.h"
 #include "util.h"
+#include "core/instance.h"
 
 static int finished;
 static int selection;
@@ -94,7 +95,7 @@ void menu_dialog_run(menu_dialog_t *_dialog) {
     finished = 0;
     dialog = _dialog;
 
-    while(!finished && (moo.state & MOO_RUNNING_BIT)) {
+    while(!finished && (MOO.state & MOO_RUNNING_BIT)) {
         draw();
         sys_handle_events(dialog_input_event);
     }
@@ -3,6 +3,7 @@
 #include "core/moo.h"
 #include "util/pathes.h"
 #include "util/state.h"
+#include "core/instance.h"
 
 static menu_dialog_t *continue_dialog = NULL;
 static menu_dialog_t *warn_rtc_sav_conflict_dialog = NULL;
@@ -39,7 +40,7 @@ void menu_warn_rtc_sav_conflict() {
 }
 
 void menu_error() {
-    error_dialog = menu_dialog_new_message(moo.error->text);
+    error_dialog = menu_dialog_new_message(MOO.error->text);
     menu_dialog_run(error_dialog);
     menu_dialog_free(error_dialog);
     moo_clear_error();
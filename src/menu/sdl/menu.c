@@ -14,6 +14,7 @@
 #include "util/pathes.h"
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
+#include "core/instance.h"
 
 
 #define LABEL_RESUME            0
@@ -33,7 +34,7 @@ static int save_slot = 0;
 static SDL_Surface *background = NULL;
 
 static void back() {
-    if(moo.state & MOO_ROM_LOADED_BIT) {
+    if(MOO.state & MOO_ROM_LOADED_BIT) {
         moo_continue();
     }
 }
@@ -80,11 +81,11 @@ static const char *filename(const char *filepath) {
 static void setup() {
     int have_last_rom = last_rom_exists();
 
-    menu_listentry_visible(list, LABEL_LOAD_LAST_ROM, (~moo.state & MOO_ROM_LOADED_BIT) && have_last_rom);
-    menu_listentry_visible(list, LABEL_RESUME, moo.state & MOO_ROM_LOADED_BIT);
-    menu_listentry_visible(list, LABEL_RESET, moo.state & MOO_ROM_LOADED_BIT);
-    menu_listentry_visible(list, LABEL_LOAD_STATE, moo.state & MOO_ROM_LOADED_BIT);
-    menu_listentry_visible(list, LABEL_SAVE_STATE, moo.state & MOO_ROM_LOADED_BIT);
+    menu_listentry_visible(list, LABEL_LOAD_LAST_ROM, (~MOO.state & MOO_ROM_LOADED_BIT) && have_last_rom);
+    menu_listentry_visible(list, LABEL_RESUME, MOO.state & MOO_ROM_LOADED_BIT);
+    menu_listentry_visible(list, LABEL_RESET, MOO.state & MOO_ROM_LOADED_BIT);
+    menu_listentry_visible(list, LABEL_LOAD_STATE, MOO.state & MOO_ROM_LOADED_BIT);
+    menu_listentry_visible(list, LABEL_SAVE_STATE, MOO.state & MOO_ROM_LOADED_BIT);
 
     menu_list_select_first(list);
 
@@ -125,7 +126,7 @@ static void menu_input_event(int type, int key) {
 
 static void mainmenu() {
     setup();
-    while((~moo.state & MOO_ROM_RUNNING_BIT) && (moo.state & MOO_RUNNING_BIT) && (~moo.state & MOO_ERROR_BIT)) {
+    while((~MOO.state & MOO_ROM_RUNNING_BIT) && (MOO.state & MOO_RUNNING_BIT) && (~MOO.state & MOO_ERROR_BIT)) {
         draw();
         sys_handle_events(menu_input_event);
         menu_list_update(list);
@@ -174,8 +175,8 @@ void menu_close() {
 }
 
 void menu_run() {
-    while((~moo.state & MOO_ROM_RUNNING_BIT) && (moo.state & MOO_RUNNING_BIT)) {
-        if(moo.state & MOO_ERROR_BIT) {
+    while((~MOO.state & MOO_ROM_RUNNING_BIT) && (MOO.state & MOO_RUNNING_BIT)) {
+        if(MOO.state & MOO_ERROR_BIT) {
             menu_error();
         }
         else {
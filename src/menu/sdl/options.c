@@ -7,6 +7,7 @@
 #include "util.h"
 #include "core/moo.h"
 #include <SDL/SDL.h>
+#include "core/instance.h"
 
 #define LABEL_SOUND 0
 #define LABEL_SCALING 1
@@ -146,9 +147,9 @@ static void options_input_event(int type, int key) {
 static void setup() {
     finished = 0;
 
-    menu_listentry_visible(list, LABEL_AUTO_RTC, mbc.has_rtc);
-    menu_listentry_visible(list, LABEL_SAVE_LOCAL, moo.state & MOO_ROM_LOADED_BIT);
-    menu_listentry_visible(list, LABEL_LOAD_LOCAL, moo.state & MOO_ROM_LOADED_BIT);
+    menu_listentry_visible(list, LABEL_AUTO_RTC, MBC.has_rtc);
+    menu_listentry_visible(list, LABEL_SAVE_LOCAL, MOO.state & MOO_ROM_LOADED_BIT);
+    menu_listentry_visible(list, LABEL_LOAD_LOCAL, MOO.state & MOO_ROM_LOADED_BIT);
 
     update_options();
 }
@@ -156,7 +157,7 @@ static void setup() {
 void menu_options() {
     setup();
 
-    while(!finished && (moo.state & MOO_RUNNING_BIT)) {
+    while(!finished && (MOO.state & MOO_RUNNING_BIT)) {
         draw();
         sys_handle_events(options_input_event);
         menu_list_update(list);
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include "core/instance.h"
 
 typedef struct {
     int is_file;
@@ -335,7 +336,7 @@ void menu_rom() {
 
     poll_dir();
 
-    while(!finished && (moo.state & MOO_RUNNING_BIT)) {
+    while(!finished && (MOO.state & MOO_RUNNING_BIT)) {
         draw();
         sys_handle_events(rom_input_event);
         menu_list_update(list);
@@ -0,0 +1,78 @@
+#include "sys/sys.h"
+#include <string.h>
+#include <stdlib.h>
+#include "core/moo.h"
+#include "core/lcd.h"
+#include "core/instance.h"
+#include "util/framerate.h"
+
+/*
+    Backend without any video, audio or input. Used by the headless runner,
+    which drives moo_cycle() itself and thus never needs frame pacing or
+    event polling.
+*/
+
+sys_t sys;
+
+void sys_init(int argc, const char** argv) {
+    memset(&sys, 0x00, sizeof(sys));
+
+    sys.sound_on = 0;
+    sys.sound_freq = 48000;
+    sys.sound_sample_size = 2;
+    sys.sound_buf_size = 4096;
+    sys.sound_buf = malloc(sys.sound_buf_size * sys.sound_sample_size * 2);
+    sys.quantum_length = 1000;
+    sys.bits_per_pixel = 16;
+    sys.bytes_per_pixel = 2;
+    sys.auto_continue = SYS_AUTO_CONTINUE_NO;
+    sys.num_scalingmodes = 1;
+    MOO.state = MOO_RUNNING_BIT;
+}
+
+void sys_reset() {
+    sys.sound_buf_start = 0;
+    sys.sound_buf_end = 0;
+    sys.ticks = 0;
+}
+
+void sys_close() {
+    free(sys.sound_buf);
+}
+
+void sys_pause() {
+}
+
+void sys_continue() {
+}
+
+void sys_begin() {
+}
+
+void sys_delay(int ticks) {
+}
+
+void sys_invoke() {
+}
+
+// Instances run on worker threads, lcd.fb_ready tells each one's state
+void sys_fb_ready() {
+}
+
+// framerate.frameskip is set by the headless runner, frames are counted per instance
+int sys_draw_frame() {
+    return framerate.frameskip <= 0 || (LCD.frames + 1) % (framerate.frameskip + 1) == 0;
+}
+
+void sys_play_audio(int on) {
+}
+
+void sys_handle_events(void (*input_handle)(int, int)) {
+}
+
+void sys_new_performance_info() {
+}
+
+void sys_set_scalingmode(int mode) {
+    sys.scalingmode = mode;
+}
@@ -1,78 +1,66 @@
 #include "audio.h"
-#include "core/sound.h"
 #include "core/moo.h"
 #include "sys/sys.h"
-#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL/SDL.h>
 
-static SDL_mutex *mutex;
+static s16 last_l, last_r;
 
 
-void sys_lock_audiobuf() {
-    SDL_mutexP(mutex);
-}
-
-void sys_unlock_audiobuf() {
-    SDL_mutexV(mutex);
-}
-
-static u16 get_available_samples() {
-    u16 r;
-    if(sys.sound_buf_start > sys.sound_buf_end) {
-        r = sys.sound_buf_size - (sys.sound_buf_start - sys.sound_buf_end) + 1;
-    }
-    else {
-        r = sys.sound_buf_end - sys.sound_buf_start;
-    }
-
-    return r;
-}
-
+/*
+    Runs on the audio thread and only hands out what the emulation already
+    mixed, see sound.c. It never touches the emulation's state. On an
+    underrun, e.g. while emulation is paused, the last sample fades out
+    instead of clicking
+*/
 static void handout_buf(void *_unused, Uint8 *stream, int length) {
-    u16 requested_samples = length / (sys.sound_sample_size * 2);
-    u16 available_samples;
-    u16 served_samples;
-
-    sys_lock_audiobuf();
-
-    if(!sys.sound_on || (~moo.state & MOO_ROM_RUNNING_BIT)) {
+    s16 *out = (s16*)stream;
+    const s16 *buf = (const s16*)sys.sound_buf;
+    u32 requested_samples = length / (sys.sound_sample_size * 2);
+    u32 start = sys.sound_buf_start;
+    u32 end = __atomic_load_n(&sys.sound_buf_end, __ATOMIC_ACQUIRE);
+    u32 s, served_samples;
+
+    if(!sys.sound_on) {
         memset(stream, 0x00, length);
+        last_l = last_r = 0;
+        return;
     }
-    else {
-#ifdef DEBUG
-        if(get_available_samples() < requested_samples) {
-      //      printf("WARNING: Sound buffer underrun\n");
-        }
-#endif
 
-        while((available_samples = get_available_samples()) < requested_samples) {
-            sound_mix();
-        }
+    // Samples piled up while the device was paused, more than the rate
+    // control could work off
+    if(end - start > sys.sound_buf_target * 2) {
+        start = end - sys.sound_buf_target;
+    }
 
-        if(sys.sound_buf_start > sys.sound_buf_end) {
-            served_samples = sys.sound_buf_size - sys.sound_buf_start;
-            if(served_samples >= requested_samples) {
-                memcpy(stream, &sys.sound_buf[sys.sound_buf_start*2*2], length);
-            }
-            else {
-                u16 bytes = served_samples * sys.sound_sample_size * 2;
-                memcpy(&stream[0], &sys.sound_buf[sys.sound_buf_start*2*2], bytes);
-                memcpy(&stream[bytes], &sys.sound_buf[0], (requested_samples - served_samples) * sys.sound_sample_size * 2);
-            }
-        }
-        else {
-            memcpy(stream, &sys.sound_buf[sys.sound_buf_start*2*2], length);
-        }
+    served_samples = min(end - start, requested_samples);
+
+    for(s = 0; s < served_samples; s++, start++) {
+        out[s*2 + 0] = buf[(start & (sys.sound_buf_size - 1)) * 2 + 0];
+        out[s*2 + 1] = buf[(start & (sys.sound_buf_size - 1)) * 2 + 1];
+    }
+    if(served_samples > 0) {
+        last_l = out[served_samples*2 - 2];
+        last_r = out[served_samples*2 - 1];
     }
 
-    sys.sound_buf_start += requested_samples;
-    sys.sound_buf_start %= sys.sound_buf_size;
+    for(s = served_samples; s < requested_samples; s++) {
+        last_l -= last_l / 8;
+        last_r -= last_r / 8;
+        out[s*2 + 0] = last_l;
+        out[s*2 + 1] = last_r;
+    }
 
-    sys_unlock_audiobuf();
+    __atomic_store_n(&sys.sound_buf_start, start, __ATOMIC_RELEASE);
 }
 
+/*
+    Takes whatever rate the device prefers, the core resamples to it. Only
+    if the device wants another sample format SDL is left to convert
+*/
 void audio_init() {
-    SDL_AudioSpec format;
+    SDL_AudioSpec format, obtained;
 
     format.freq = sys.sound_freq;
     format.format = AUDIO_S16;
@@ -81,12 +69,22 @@ void audio_init() {
     format.callback = handout_buf;
     format.userdata = NULL;
 
-    mutex = SDL_CreateMutex();
-
-    if (SDL_OpenAudio(&format, NULL) < 0 ) {
+    if(SDL_OpenAudio(&format, &obtained) < 0) {
         moo_fatalf("Couldn't open audio device: %s", SDL_GetError());
         exit(1);
     }
+
+    if(obtained.format != format.format || obtained.channels != format.channels) {
+        SDL_CloseAudio();
+        if(SDL_OpenAudio(&format, NULL) < 0) {
+            moo_fatalf("Couldn't open audio device: %s", SDL_GetError());
+            exit(1);
+        }
+        obtained = format;
+    }
+
+    sys.sound_freq = obtained.freq;
+    sys.sound_buf_target = min(obtained.samples * 3, sys.sound_buf_size / 2);
     SDL_PauseAudio(1);
 }
 
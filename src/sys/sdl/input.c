@@ -5,6 +5,7 @@
 #include "sys/sys.h"
 #include <SDL/SDL.h>
 
+#include "core/instance.h"
 #ifdef DEBUG
 #include "debug/break.h"
 #endif // DEBUG
@@ -20,6 +20,7 @@
 #include "util/framerate.h"
 #include "util/performance.h"
 #include "util/speed.h"
+#include "core/instance.h"
 
 #define SCALING_PROPORTIONAL 0
 #define SCALING_STRECHED 1
@@ -33,20 +34,20 @@ static SDL_Surface *statuslabel;
 static char *scalingmode_names[] = {"Proportional", "Streched", "Full Proportional", "None"};
 
 void sys_init(int argc, const char** argv) {
+    SDL_Surface *screen;
+
     memset(&sys, 0x00, sizeof(sys));
 
     sys.sound_on = 0;
-    sys.sound_freq = 22050;
+    sys.sound_freq = 48000;
     sys.sound_sample_size = 2;
     sys.sound_buf_size = 4096;
     sys.sound_buf = malloc(sys.sound_buf_size * sys.sound_sample_size * 2);
     sys.quantum_length = 1000;
-    sys.bits_per_pixel = 16;
-    sys.bytes_per_pixel = 2;
     sys.show_statusbar = 0;
     sys.auto_continue = SYS_AUTO_CONTINUE_ASK;
     sys.fb_ready = 0;
-    moo.state = MOO_RUNNING_BIT;
+    MOO.state = MOO_RUNNING_BIT;
 
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
         moo_fatalf("Couln't initialize SDL");
@@ -66,9 +67,16 @@ void sys_init(int argc, const char** argv) {
 
     SDL_ShowCursor(0);
 
-    if(SDL_SetVideoMode(screen_w, screen_h, sys.bits_per_pixel, flags) == NULL) {
+    // The display's own depth, if frames can be converted to it
+    screen = SDL_SetVideoMode(screen_w, screen_h, 0, flags);
+    if(screen != NULL && screen->format->BytesPerPixel != 2 && screen->format->BytesPerPixel != 4) {
+        screen = SDL_SetVideoMode(screen_w, screen_h, 16, flags);
+    }
+    if(screen == NULL) {
         moo_fatalf("Setting of SDL video-mode failed");
     }
+    sys.bits_per_pixel = screen->format->BitsPerPixel;
+    sys.bytes_per_pixel = screen->format->BytesPerPixel;
 
     if(!IMG_Init(IMG_INIT_PNG)) {
         moo_fatalf("Initialisation of SDL_image failed");
@@ -81,20 +89,22 @@ void sys_init(int argc, const char** argv) {
     audio_init();
     framerate_init();
     input_init();
-    video_init();
+    render_enable();
 
     statuslabel = SDL_CreateRGBSurface(0, SDL_GetVideoSurface()->w, 8, sys.bits_per_pixel, 0, 0, 0, 0);
     assert(statuslabel != NULL);
 }
 
 void sys_reset() {
+    SDL_LockAudio();
     sys.sound_buf_start = 0;
     sys.sound_buf_end = 0;
+    SDL_UnlockAudio();
     sys.ticks = 0;
-    sys.invoke_cc = 0;
 }
 
 void sys_close() {
+    render_disable();
     free(sys.sound_buf);
 
     video_close();
@@ -181,6 +191,10 @@ void sys_fb_ready() {
     sys.fb_ready = 1;
 }
 
+int sys_draw_frame() {
+    return framerate_draw_frame();
+}
+
 void sys_handle_events(void (*input_handle)(int, int)) {
    SDL_Event event;
 
@@ -221,7 +235,7 @@ void sys_play_audio(int on) {
 
 void sys_new_performance_info() {
     char statusline[256];
-    snprintf(statusline, sizeof(statusline), "Skipped %i/%i frames, Slept %6.2f %%, Speed: %6.2f %%, CPU: %i Hz", performance.counters.skipped, performance.counters.frames, (float)performance.counters.slept*100/PERFORMANCE_UPDATE_PERIOD, performance.speed, cpu.freq);
+    snprintf(statusline, sizeof(statusline), "Skipped %i/%i frames, Slept %6.2f %%, Speed: %6.2f %%, CPU: %i Hz", performance.counters.skipped, performance.counters.frames, (float)performance.counters.slept*100/PERFORMANCE_UPDATE_PERIOD, performance.speed, CPU.freq);
 
     SDL_FillRect(statuslabel, NULL, 0);
     stringColor(statuslabel, 0, 0, statusline, 0xaaaaaaff);
@@ -13,13 +13,14 @@ typedef struct {
     int sound_on;
     int sound_freq;
     int sound_sample_size;
-    u16 sound_buf_size;
-    u16 sound_buf_start;
-    u16 sound_buf_end;
+    // Ring of stereo samples, see sound.c. The indices run freely, start
+    // is only advanced by the audio device, end only by emulation
+    u32 sound_buf_size; // Power of two
+    u32 sound_buf_start;
+    u32 sound_buf_end; // Samples up to here are handed out
+    u32 sound_buf_target; // Fill level the rate control aims at, 0 for none
     u8 *sound_buf;
 
-    int invoke_cc;
-
     int running;
     int state;
 
@@ -59,10 +60,9 @@ void sys_delay(int ticks);
 
 void sys_invoke();
 void sys_fb_ready();
+int sys_draw_frame();
 
 void sys_play_audio(int on);
-void sys_lock_audiobuf();
-void sys_unlock_audiobuf();
 
 void sys_handle_events(void (*input_handle)(int, int));
 
@@ -70,9 +70,6 @@ void sys_new_performance_info();
 
 void sys_set_scalingmode(int mode);
 
-u16 sys_map_cgb_color(u16 lcd_color);
-u16 sys_map_dmg_color(u16 lcd_color);
-
 //void sys_serial_connect();
 //void sys_serial_step();
 //int sys_serial_incoming();
@@ -10,6 +10,7 @@
 #include "core/rtc.h"
 #include "core/moo.h"
 #include "util/pathes.h"
+#include "core/instance.h"
 
 static FILE *file;
 
@@ -29,24 +30,24 @@ static void write(void *ptr, size_t size) {
 }
 
 static void io_ram(void (*io)(void *ptr, size_t size)) {
-    if(mbc.has_ram) {
-        io(card.srambanks, card.sramsize * sizeof(*card.srambanks));
+    if(MBC.has_ram) {
+        io(CARD.srambanks, CARD.sramsize * sizeof(*CARD.srambanks));
     }
 }
 
 static void io_rtc(void (*io)(void *ptr, size_t size), time_t *timestamp) {
-    if(mbc.has_rtc) {
-        io(rtc.latched, sizeof(rtc.latched));
-        io(rtc.ticking, sizeof(rtc.ticking));
-        io(&rtc.mapped, sizeof(rtc.mapped));
-        io(&rtc.prelatched, sizeof(rtc.prelatched));
-        io(&rtc.cc, sizeof(rtc.cc));
+    if(MBC.has_rtc) {
+        io(RTC.latched, sizeof(RTC.latched));
+        io(RTC.ticking, sizeof(RTC.ticking));
+        io(&RTC.mapped, sizeof(RTC.mapped));
+        io(&RTC.prelatched, sizeof(RTC.prelatched));
+        io(&RTC.cc, sizeof(RTC.cc));
         io(timestamp, sizeof(*timestamp));
     }
 }
 
 void card_save() {
-    if(!mbc.has_battery || !(mbc.has_ram || mbc.has_rtc)) {
+    if(!MBC.has_battery || !(MBC.has_ram || MBC.has_rtc)) {
         return;
     }
 
@@ -69,7 +70,7 @@ void card_save() {
 }
 
 void card_load() {
-    if(!mbc.has_battery || !(mbc.has_ram || mbc.has_rtc)) {
+    if(!MBC.has_battery || !(MBC.has_ram || MBC.has_rtc)) {
         return;
     }
 
@@ -85,7 +86,7 @@ void card_load() {
     time_t card_ts;
     io_rtc(read, &card_ts);
 
-    if(mbc.has_rtc && sys.auto_rtc) {
+    if(MBC.has_rtc && sys.auto_rtc) {
         time_t now_ts = time(NULL);
         if(now_ts > card_ts) {
             rtc_advance_seconds(now_ts - card_ts);
@@ -3,6 +3,7 @@
 #include "sys/sys.h"
 #include "core/cpu.h"
 #include "core/moo.h"
+#include "util/speed.h"
 #include <stdio.h>
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
@@ -17,6 +18,7 @@ void framerate_init() {
     framerate.skipped = 0;
     framerate.first_frame_ticks = 0;
     framerate.framecount = 0;
+    framerate.drawn_framecount = 0;
 }
 
 void framerate_reset() {
@@ -26,47 +28,70 @@ void framerate_reset() {
 void framerate_begin() {
     framerate.first_frame_ticks = sys.ticks;
     framerate.cc_ahead = 0;
+    framerate.drawn_framecount = 0;
 }
 
-int framerate_next_frame() {
+/*
+    Asked by the core before it begins a frame. Skipped frames are neither
+    drawn nor presented, the previously drawn one stays on screen
+*/
+int framerate_draw_frame() {
     unsigned int should_framecount;
-    int next_frame;
+    int draw_frame;
 
-    // Check if we're in time for a next frame
     should_framecount = ((sys.ticks - framerate.first_frame_ticks) * 60) / 1000;
-    if(should_framecount <= framerate.framecount || !sys.fb_ready) {
-        return 0;
-    }
 
     // Fixed frameskip
     if(framerate.frameskip >= 0) {
         if(framerate.skipped >= framerate.frameskip) {
             framerate.skipped = 0;
-            next_frame = 1;
+            draw_frame = 1;
         }
         else {
             framerate.skipped++;
-            next_frame = 0;
+            draw_frame = 0;
         }
     }
+    // Fast forward, only one frame per presented one is needed
+    else if(speed.factor > 1) {
+        draw_frame = should_framecount > framerate.drawn_framecount;
+    }
     else {
         // Autoframeskip, but we skipped too many
         if(framerate.skipped >= framerate.max_frameskip) {
             framerate.skipped = 0;
-            next_frame = 1;
+            draw_frame = 1;
         }
         // Autoframeskip, shall we?
         else if(should_framecount > framerate.framecount + 1) {
             framerate.skipped++;
-            performance.counting.skipped++;
-            next_frame = 0;
+            draw_frame = 0;
         }
         else {
-            next_frame = 1;
+            draw_frame = 1;
         }
     }
 
+    if(draw_frame) {
+        framerate.drawn_framecount = should_framecount;
+    }
+    else {
+        performance.counting.skipped++;
+    }
+
+    return draw_frame;
+}
+
+// Whether a drawn frame is ready and it's time to present it
+int framerate_next_frame() {
+    unsigned int should_framecount;
+
+    should_framecount = ((sys.ticks - framerate.first_frame_ticks) * 60) / 1000;
+    if(should_framecount <= framerate.framecount || !sys.fb_ready) {
+        return 0;
+    }
+
     framerate.framecount = should_framecount;
-    return next_frame;
+    return 1;
 }
 
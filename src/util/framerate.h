@@ -12,6 +12,7 @@ typedef struct {
     int delay_threshold;
     time_t first_frame_ticks;
     size_t framecount;
+    size_t drawn_framecount;
 } framerate_t;
 
 extern framerate_t framerate;
@@ -19,6 +20,7 @@ extern framerate_t framerate;
 void framerate_init();
 void framerate_reset();
 void framerate_begin();
+int framerate_draw_frame();
 int framerate_next_frame();
 
 #endif // SYS_ADJUST_FRAMERATE_H
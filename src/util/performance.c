@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include "core/instance.h"
 
 
 performance_t performance;
@@ -16,13 +17,13 @@ void performance_reset() {
 }
 
 void performance_invoked() {
-    performance.update_cc += sys.invoke_cc;
+    performance.update_cc += HW.invoke_cc;
 
     if(sys.ticks < performance.last_update_ticks + PERFORMANCE_UPDATE_PERIOD) {
         return;
     }
 
-    performance.speed = (float)(performance.update_cc * 1000.0 * 100.0) / (cpu.freq * PERFORMANCE_UPDATE_PERIOD);
+    performance.speed = (float)(performance.update_cc * 1000.0 * 100.0) / (CPU.freq * PERFORMANCE_UPDATE_PERIOD);
 
     memcpy(&performance.counters, &performance.counting, sizeof(performance.counting));
     memset(&performance.counting, 0x00, sizeof(performance.counting));
@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include "pool.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "core/moo.h"
+
+typedef struct {
+    moo_instance_t *instance;
+    int worker;
+} pool_entry_t;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    pool_t *pool;
+
+    // Stealable work, owner pops from the bottom, thieves take from the top
+    pthread_mutex_t lock;
+    int *jobs;
+    int top, bottom;
+
+    // Work only this worker may run
+    int *pinned;
+    int num_pinned;
+} pool_worker_t;
+
+struct pool_s {
+    pool_worker_t *workers;
+    int num_workers;
+
+    pool_entry_t *entries;
+    int num_entries;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    int generation;
+    int pending; // Workers not yet done with the current batch
+    int quit;
+
+    void (*run)(int);
+    int num;
+};
+
+static int pop_job(pool_worker_t *worker) {
+    int job = -1;
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->bottom > worker->top) {
+        job = worker->jobs[--worker->bottom];
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return job;
+}
+
+static int steal_job(pool_worker_t *thief) {
+    pool_t *pool = thief->pool;
+    int w, job = -1;
+
+    for(w = 1; w < pool->num_workers && job < 0; w++) {
+        pool_worker_t *victim = &pool->workers[(thief->index + w) % pool->num_workers];
+
+        pthread_mutex_lock(&victim->lock);
+        if(victim->bottom > victim->top) {
+            job = victim->jobs[victim->top++];
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    return job;
+}
+
+static void run_entry(pool_t *pool, int e) {
+    moo_instance_select(pool->entries[e].instance);
+    if(MOO.state & MOO_ROM_RUNNING_BIT) {
+        pool->run(pool->num);
+    }
+}
+
+static void pin(pool_worker_t *worker) {
+#ifdef __linux__
+    cpu_set_t set;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    CPU_ZERO(&set);
+    CPU_SET(worker->index % (num_cpus > 0 ? num_cpus : 1), &set);
+    pthread_setaffinity_np(worker->thread, sizeof(set), &set);
+#endif
+}
+
+static void *work(void *arg) {
+    pool_worker_t *worker = arg;
+    pool_t *pool = worker->pool;
+    int generation = 0;
+
+    for(;;) {
+        int p, job, quit;
+
+        pthread_mutex_lock(&pool->lock);
+        while(pool->generation == generation && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        generation = pool->generation;
+        quit = pool->quit;
+        pthread_mutex_unlock(&pool->lock);
+
+        if(quit) {
+            break;
+        }
+
+        for(p = 0; p < worker->num_pinned; p++) {
+            run_entry(pool, worker->pinned[p]);
+        }
+        while((job = pop_job(worker)) >= 0 || (job = steal_job(worker)) >= 0) {
+            run_entry(pool, job);
+        }
+
+        // Only once every worker checked in the queues may be refilled
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        if(pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+pool_t *pool_create(int num_workers, int pin_workers) {
+    pool_t *pool = calloc(1, sizeof(*pool));
+    int w;
+
+    if(num_workers <= 0) {
+        num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = num_workers > 0 ? num_workers : 1;
+    }
+
+    pool->num_workers = num_workers;
+    pool->workers = calloc(num_workers, sizeof(*pool->workers));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(w = 0; w < num_workers; w++) {
+        pool_worker_t *worker = &pool->workers[w];
+
+        worker->index = w;
+        worker->pool = pool;
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_create(&worker->thread, NULL, work, worker);
+
+        if(pin_workers) {
+            pin(worker);
+        }
+    }
+
+    return pool;
+}
+
+void pool_destroy(pool_t *pool) {
+    int w;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(w = 0; w < pool->num_workers; w++) {
+        pthread_join(pool->workers[w].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[w].lock);
+        free(pool->workers[w].jobs);
+        free(pool->workers[w].pinned);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->workers);
+    free(pool->entries);
+    free(pool);
+}
+
+void pool_add(pool_t *pool, moo_instance_t *instance, int worker) {
+    int w;
+
+    assert(worker == POOL_ANY_WORKER || (worker >= 0 && worker < pool->num_workers));
+
+    pool->entries = realloc(pool->entries, (pool->num_entries + 1) * sizeof(*pool->entries));
+    pool->entries[pool->num_entries].instance = instance;
+    pool->entries[pool->num_entries].worker = worker;
+    pool->num_entries++;
+
+    for(w = 0; w < pool->num_workers; w++) {
+        pool->workers[w].jobs = realloc(pool->workers[w].jobs, pool->num_entries * sizeof(int));
+        pool->workers[w].pinned = realloc(pool->workers[w].pinned, pool->num_entries * sizeof(int));
+    }
+}
+
+static void run_batch(pool_t *pool, void (*run)(int), int num) {
+    int e, w, next = 0;
+
+    if(pool->num_entries == 0) {
+        return;
+    }
+
+    for(w = 0; w < pool->num_workers; w++) {
+        pool->workers[w].top = 0;
+        pool->workers[w].bottom = 0;
+        pool->workers[w].num_pinned = 0;
+    }
+    for(e = 0; e < pool->num_entries; e++) {
+        pool_worker_t *worker;
+
+        if(pool->entries[e].worker == POOL_ANY_WORKER) {
+            worker = &pool->workers[next++ % pool->num_workers];
+            worker->jobs[worker->bottom++] = e;
+        }
+        else {
+            worker = &pool->workers[pool->entries[e].worker];
+            worker->pinned[worker->num_pinned++] = e;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->run = run;
+    pool->num = num;
+    pool->pending = pool->num_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+
+    while(pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_cycle(pool_t *pool, int num) {
+    run_batch(pool, moo_cycle, num);
+}
+
+void pool_run_frames(pool_t *pool, int num) {
+    run_batch(pool, moo_run_frames, num);
+}
@@ -0,0 +1,25 @@
+#ifndef UTIL_POOL_H
+#define UTIL_POOL_H
+
+#include "core/instance.h"
+
+#define POOL_ANY_WORKER -1
+
+typedef struct pool_s pool_t;
+
+/*
+    Steps many instances on a fixed set of worker threads. Each batch call
+    advances every added instance and returns once all of them are done.
+    Instances added with POOL_ANY_WORKER are handed out round robin and may
+    be stolen by idle workers, others always run on the given worker.
+*/
+
+pool_t *pool_create(int num_workers, int pin_workers);
+void pool_destroy(pool_t *pool);
+
+void pool_add(pool_t *pool, moo_instance_t *instance, int worker);
+
+void pool_cycle(pool_t *pool, int num);
+void pool_run_frames(pool_t *pool, int num);
+
+#endif
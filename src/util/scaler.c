@@ -0,0 +1,506 @@
+#include "scaler.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define SCALER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCALER_NEON
+#endif
+
+typedef void (*kernel_t)(const void *src, void *dst);
+
+// Spreads a 5 bit component over 8 bits, so white stays white in every format
+#define EXPAND(c) ((c) << 3 | (c) >> 2)
+
+static inline u32 convert_pixel(const scaler_format_t *f, u16 color) {
+    u32 r = EXPAND(color & 0x1F);
+    u32 g = EXPAND((color >> 5) & 0x1F);
+    u32 b = EXPAND((color >> 10) & 0x1F);
+
+    return (r >> f->rloss) << f->rshift | (g >> f->gloss) << f->gshift | (b >> f->bloss) << f->bshift | f->alpha;
+}
+
+#if defined(SCALER_SSE2)
+// Splits 8 colors into their components, expanded to 8 bits in 16 bit lanes
+static inline void split(__m128i v, __m128i *r, __m128i *g, __m128i *b) {
+    __m128i mask = _mm_set1_epi16(0x1F);
+
+    *r = _mm_and_si128(v, mask);
+    *g = _mm_and_si128(_mm_srli_epi16(v, 5), mask);
+    *b = _mm_and_si128(_mm_srli_epi16(v, 10), mask);
+    *r = _mm_or_si128(_mm_slli_epi16(*r, 3), _mm_srli_epi16(*r, 2));
+    *g = _mm_or_si128(_mm_slli_epi16(*g, 3), _mm_srli_epi16(*g, 2));
+    *b = _mm_or_si128(_mm_slli_epi16(*b, 3), _mm_srli_epi16(*b, 2));
+}
+
+#define PLACE16(c, loss, shift) _mm_sll_epi16(_mm_srl_epi16(c, _mm_cvtsi32_si128(loss)), _mm_cvtsi32_si128(shift))
+#define PLACE32(c, loss, shift) _mm_sll_epi32(_mm_srl_epi32(c, _mm_cvtsi32_si128(loss)), _mm_cvtsi32_si128(shift))
+#elif defined(SCALER_NEON)
+static inline void split(uint16x8_t v, uint16x8_t *r, uint16x8_t *g, uint16x8_t *b) {
+    uint16x8_t mask = vdupq_n_u16(0x1F);
+
+    *r = vandq_u16(v, mask);
+    *g = vandq_u16(vshrq_n_u16(v, 5), mask);
+    *b = vandq_u16(vshrq_n_u16(v, 10), mask);
+    *r = vorrq_u16(vshlq_n_u16(*r, 3), vshrq_n_u16(*r, 2));
+    *g = vorrq_u16(vshlq_n_u16(*g, 3), vshrq_n_u16(*g, 2));
+    *b = vorrq_u16(vshlq_n_u16(*b, 3), vshrq_n_u16(*b, 2));
+}
+
+#define PLACE16(c, loss, shift) vshlq_u16(vshlq_u16(c, vdupq_n_s16(-(loss))), vdupq_n_s16(shift))
+#define PLACE32(c, loss, shift) vshlq_u32(vshlq_u32(c, vdupq_n_s32(-(loss))), vdupq_n_s32(shift))
+#endif
+
+static void convert_line16(const scaler_format_t *f, const u16 *src, u16 *dst) {
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    __m128i r, g, b;
+
+    for(; x < 160; x += 8) {
+        split(_mm_loadu_si128((const __m128i*)&src[x]), &r, &g, &b);
+        r = PLACE16(r, f->rloss, f->rshift);
+        g = PLACE16(g, f->gloss, f->gshift);
+        b = PLACE16(b, f->bloss, f->bshift);
+        _mm_storeu_si128((__m128i*)&dst[x], _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, _mm_set1_epi16(f->alpha))));
+    }
+#elif defined(SCALER_NEON)
+    uint16x8_t r, g, b;
+
+    for(; x < 160; x += 8) {
+        split(vld1q_u16(&src[x]), &r, &g, &b);
+        r = PLACE16(r, f->rloss, f->rshift);
+        g = PLACE16(g, f->gloss, f->gshift);
+        b = PLACE16(b, f->bloss, f->bshift);
+        vst1q_u16(&dst[x], vorrq_u16(vorrq_u16(r, g), vorrq_u16(b, vdupq_n_u16(f->alpha))));
+    }
+#endif
+
+    for(; x < 160; x++) {
+        dst[x] = convert_pixel(f, src[x]);
+    }
+}
+
+static void convert_line32(const scaler_format_t *f, const u16 *src, u32 *dst) {
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    __m128i r, g, b, half;
+    int h;
+
+    for(; x < 160; x += 8) {
+        split(_mm_loadu_si128((const __m128i*)&src[x]), &r, &g, &b);
+
+        for(h = 0; h < 2; h++) {
+            __m128i zero = _mm_setzero_si128();
+            __m128i r32 = h ? _mm_unpackhi_epi16(r, zero) : _mm_unpacklo_epi16(r, zero);
+            __m128i g32 = h ? _mm_unpackhi_epi16(g, zero) : _mm_unpacklo_epi16(g, zero);
+            __m128i b32 = h ? _mm_unpackhi_epi16(b, zero) : _mm_unpacklo_epi16(b, zero);
+
+            half = _mm_or_si128(PLACE32(r32, f->rloss, f->rshift), PLACE32(g32, f->gloss, f->gshift));
+            half = _mm_or_si128(half, _mm_or_si128(PLACE32(b32, f->bloss, f->bshift), _mm_set1_epi32(f->alpha)));
+            _mm_storeu_si128((__m128i*)&dst[x + h*4], half);
+        }
+    }
+#elif defined(SCALER_NEON)
+    uint16x8_t r, g, b;
+    uint32x4_t half;
+
+    for(; x < 160; x += 8) {
+        split(vld1q_u16(&src[x]), &r, &g, &b);
+
+        half = vorrq_u32(PLACE32(vmovl_u16(vget_low_u16(r)), f->rloss, f->rshift), PLACE32(vmovl_u16(vget_low_u16(g)), f->gloss, f->gshift));
+        half = vorrq_u32(half, vorrq_u32(PLACE32(vmovl_u16(vget_low_u16(b)), f->bloss, f->bshift), vdupq_n_u32(f->alpha)));
+        vst1q_u32(&dst[x], half);
+
+        half = vorrq_u32(PLACE32(vmovl_u16(vget_high_u16(r)), f->rloss, f->rshift), PLACE32(vmovl_u16(vget_high_u16(g)), f->gloss, f->gshift));
+        half = vorrq_u32(half, vorrq_u32(PLACE32(vmovl_u16(vget_high_u16(b)), f->bloss, f->bshift), vdupq_n_u32(f->alpha)));
+        vst1q_u32(&dst[x + 4], half);
+    }
+#endif
+
+    for(; x < 160; x++) {
+        dst[x] = convert_pixel(f, src[x]);
+    }
+}
+
+static inline void replicate16(const u16 *src, u16 *dst, int num, int factor) {
+    int x, f;
+
+    for(x = 0; x < num; x++) {
+        for(f = 0; f < factor; f++) {
+            *dst++ = src[x];
+        }
+    }
+}
+
+static inline void replicate32(const u32 *src, u32 *dst, int num, int factor) {
+    int x, f;
+
+    for(x = 0; x < num; x++) {
+        for(f = 0; f < factor; f++) {
+            *dst++ = src[x];
+        }
+    }
+}
+
+#if defined(SCALER_SSE2)
+/*
+    Picks 4 pixels for the low half of the result from the low half of a and
+    4 for the high half from the low half of b
+*/
+#define PICK16(a, b, l0, l1, l2, l3, h0, h1, h2, h3) \
+    _mm_shufflehi_epi16(_mm_shufflelo_epi16(_mm_unpacklo_epi64(a, b), _MM_SHUFFLE(l3, l2, l1, l0)), _MM_SHUFFLE(h3, h2, h1, h0))
+
+#define PICK32(v, p0, p1, p2, p3) _mm_shuffle_epi32(v, _MM_SHUFFLE(p3, p2, p1, p0))
+
+#define STORE(n, v) _mm_storeu_si128((__m128i*)dst + (n), v)
+#define LOAD(x) _mm_loadu_si128((const __m128i*)&src[x])
+#endif
+
+static void line16_2x(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 8, dst += 16) {
+        __m128i v = LOAD(x);
+        STORE(0, _mm_unpacklo_epi16(v, v));
+        STORE(1, _mm_unpackhi_epi16(v, v));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 8, dst += 16) {
+        uint16x8x2_t r;
+        r.val[0] = r.val[1] = vld1q_u16(&src[x]);
+        vst2q_u16(dst, r);
+    }
+#endif
+
+    replicate16(&src[x], dst, 160 - x, 2);
+}
+
+static void line16_3x(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 8, dst += 24) {
+        __m128i l = LOAD(x);
+        __m128i h = _mm_unpackhi_epi64(l, l);
+        STORE(0, PICK16(l, l, 0, 0, 0, 1, 1, 1, 2, 2));
+        STORE(1, PICK16(l, h, 2, 3, 3, 3, 0, 0, 0, 1));
+        STORE(2, PICK16(h, h, 1, 1, 2, 2, 2, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 8, dst += 24) {
+        uint16x8x3_t r;
+        r.val[0] = r.val[1] = r.val[2] = vld1q_u16(&src[x]);
+        vst3q_u16(dst, r);
+    }
+#endif
+
+    replicate16(&src[x], dst, 160 - x, 3);
+}
+
+static void line16_4x(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 8, dst += 32) {
+        __m128i v = LOAD(x);
+        __m128i l = _mm_unpacklo_epi16(v, v);
+        __m128i h = _mm_unpackhi_epi16(v, v);
+        STORE(0, _mm_unpacklo_epi32(l, l));
+        STORE(1, _mm_unpackhi_epi32(l, l));
+        STORE(2, _mm_unpacklo_epi32(h, h));
+        STORE(3, _mm_unpackhi_epi32(h, h));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 8, dst += 32) {
+        uint16x8x4_t r;
+        r.val[0] = r.val[1] = r.val[2] = r.val[3] = vld1q_u16(&src[x]);
+        vst4q_u16(dst, r);
+    }
+#endif
+
+    replicate16(&src[x], dst, 160 - x, 4);
+}
+
+static void line16_5x(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 8, dst += 40) {
+        __m128i l = LOAD(x);
+        __m128i h = _mm_unpackhi_epi64(l, l);
+        STORE(0, PICK16(l, l, 0, 0, 0, 0, 0, 1, 1, 1));
+        STORE(1, PICK16(l, l, 1, 1, 2, 2, 2, 2, 2, 3));
+        STORE(2, PICK16(l, h, 3, 3, 3, 3, 0, 0, 0, 0));
+        STORE(3, PICK16(h, h, 0, 1, 1, 1, 1, 1, 2, 2));
+        STORE(4, PICK16(h, h, 2, 2, 2, 3, 3, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    // Overlapping stores of 8 copies, the last pixel would write past the line
+    for(; x < 159; x++, dst += 5) {
+        vst1q_u16(dst, vdupq_n_u16(src[x]));
+    }
+#endif
+
+    replicate16(&src[x], dst, 160 - x, 5);
+}
+
+static void line16_6x(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    // Pixels doubled into 32 bit lanes, then tripled
+    for(; x < 160; x += 8, dst += 48) {
+        __m128i v = LOAD(x);
+        __m128i l = _mm_unpacklo_epi16(v, v);
+        __m128i h = _mm_unpackhi_epi16(v, v);
+        STORE(0, PICK32(l, 0, 0, 0, 1));
+        STORE(1, PICK32(l, 1, 1, 2, 2));
+        STORE(2, PICK32(l, 2, 3, 3, 3));
+        STORE(3, PICK32(h, 0, 0, 0, 1));
+        STORE(4, PICK32(h, 1, 1, 2, 2));
+        STORE(5, PICK32(h, 2, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 8, dst += 48) {
+        uint16x8_t v = vld1q_u16(&src[x]);
+        uint16x8x2_t d = vzipq_u16(v, v);
+        uint32x4x3_t r;
+        r.val[0] = r.val[1] = r.val[2] = vreinterpretq_u32_u16(d.val[0]);
+        vst3q_u32((u32*)dst, r);
+        r.val[0] = r.val[1] = r.val[2] = vreinterpretq_u32_u16(d.val[1]);
+        vst3q_u32((u32*)&dst[24], r);
+    }
+#endif
+
+    replicate16(&src[x], dst, 160 - x, 6);
+}
+
+static void line32_2x(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 4, dst += 8) {
+        __m128i v = LOAD(x);
+        STORE(0, _mm_unpacklo_epi32(v, v));
+        STORE(1, _mm_unpackhi_epi32(v, v));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 4, dst += 8) {
+        uint32x4x2_t r;
+        r.val[0] = r.val[1] = vld1q_u32(&src[x]);
+        vst2q_u32(dst, r);
+    }
+#endif
+
+    replicate32(&src[x], dst, 160 - x, 2);
+}
+
+static void line32_3x(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 4, dst += 12) {
+        __m128i v = LOAD(x);
+        STORE(0, PICK32(v, 0, 0, 0, 1));
+        STORE(1, PICK32(v, 1, 1, 2, 2));
+        STORE(2, PICK32(v, 2, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 4, dst += 12) {
+        uint32x4x3_t r;
+        r.val[0] = r.val[1] = r.val[2] = vld1q_u32(&src[x]);
+        vst3q_u32(dst, r);
+    }
+#endif
+
+    replicate32(&src[x], dst, 160 - x, 3);
+}
+
+static void line32_4x(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 4, dst += 16) {
+        __m128i v = LOAD(x);
+        STORE(0, PICK32(v, 0, 0, 0, 0));
+        STORE(1, PICK32(v, 1, 1, 1, 1));
+        STORE(2, PICK32(v, 2, 2, 2, 2));
+        STORE(3, PICK32(v, 3, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    for(; x < 160; x += 4, dst += 16) {
+        uint32x4x4_t r;
+        r.val[0] = r.val[1] = r.val[2] = r.val[3] = vld1q_u32(&src[x]);
+        vst4q_u32(dst, r);
+    }
+#endif
+
+    replicate32(&src[x], dst, 160 - x, 4);
+}
+
+static void line32_5x(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 4, dst += 20) {
+        __m128i v = LOAD(x);
+        STORE(0, PICK32(v, 0, 0, 0, 0));
+        STORE(1, PICK32(v, 0, 1, 1, 1));
+        STORE(2, PICK32(v, 1, 1, 2, 2));
+        STORE(3, PICK32(v, 2, 2, 2, 3));
+        STORE(4, PICK32(v, 3, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    // Overlapping stores of 8 copies, the last pixel would write past the line
+    for(; x < 159; x++, dst += 5) {
+        vst1q_u32(dst, vdupq_n_u32(src[x]));
+        vst1q_u32(&dst[4], vdupq_n_u32(src[x]));
+    }
+#endif
+
+    replicate32(&src[x], dst, 160 - x, 5);
+}
+
+static void line32_6x(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALER_SSE2)
+    for(; x < 160; x += 4, dst += 24) {
+        __m128i v = LOAD(x);
+        STORE(0, PICK32(v, 0, 0, 0, 0));
+        STORE(1, PICK32(v, 0, 0, 1, 1));
+        STORE(2, PICK32(v, 1, 1, 1, 1));
+        STORE(3, PICK32(v, 2, 2, 2, 2));
+        STORE(4, PICK32(v, 2, 2, 3, 3));
+        STORE(5, PICK32(v, 3, 3, 3, 3));
+    }
+#elif defined(SCALER_NEON)
+    // Overlapping stores of 8 copies, the last pixel would write past the line
+    for(; x < 159; x++, dst += 6) {
+        vst1q_u32(dst, vdupq_n_u32(src[x]));
+        vst1q_u32(&dst[4], vdupq_n_u32(src[x]));
+    }
+#endif
+
+    replicate32(&src[x], dst, 160 - x, 6);
+}
+
+// 1x is converted straight into the area
+static const kernel_t kernels16[SCALER_MAX_FACTOR + 1] = {
+    NULL, NULL, line16_2x, line16_3x, line16_4x, line16_5x, line16_6x
+};
+
+static const kernel_t kernels32[SCALER_MAX_FACTOR + 1] = {
+    NULL, NULL, line32_2x, line32_3x, line32_4x, line32_5x, line32_6x
+};
+
+// Converts a framebuffer line into line, then scales that into dst
+static inline void scale_line(const scaler_t *scaler, const u16 *src, u32 *line, void *dst) {
+    int ax;
+
+    if(scaler->format.bytes_per_pixel == 2) {
+        if(scaler->factor == 1) {
+            convert_line16(&scaler->format, src, dst);
+            return;
+        }
+        convert_line16(&scaler->format, src, (u16*)line);
+
+        if(scaler->factor != 0) {
+            kernels16[scaler->factor](line, dst);
+        }
+        else {
+            for(ax = 0; ax < scaler->w; ax++) {
+                ((u16*)dst)[ax] = ((u16*)line)[scaler->columns[ax]];
+            }
+        }
+    }
+    else {
+        if(scaler->factor == 1) {
+            convert_line32(&scaler->format, src, dst);
+            return;
+        }
+        convert_line32(&scaler->format, src, line);
+
+        if(scaler->factor != 0) {
+            kernels32[scaler->factor](line, dst);
+        }
+        else {
+            for(ax = 0; ax < scaler->w; ax++) {
+                ((u32*)dst)[ax] = line[scaler->columns[ax]];
+            }
+        }
+    }
+}
+
+void scaler_init(scaler_t *scaler, int w, int h) {
+    int ax, fbx, fbline;
+
+    scaler->w = w;
+    scaler->h = h;
+    scaler->factor = w % 160 == 0 && w / 160 <= SCALER_MAX_FACTOR ? w / 160 : 0;
+    scaler->columns = realloc(scaler->columns, max(w, 1) * sizeof(*scaler->columns));
+
+    for(ax = 0, fbx = 0; fbx < 160; fbx++) {
+        for(; ax < ((fbx + 1) * w) / 160; ax++) {
+            scaler->columns[ax] = fbx;
+        }
+    }
+    for(fbline = 0; fbline < 144; fbline++) {
+        scaler->lines[fbline] = ((fbline + 1) * h) / 144 - (fbline * h) / 144;
+    }
+}
+
+void scaler_set_format(scaler_t *scaler, const scaler_format_t *format) {
+    scaler->format = *format;
+}
+
+void scaler_close(scaler_t *scaler) {
+    free(scaler->columns);
+    scaler->columns = NULL;
+}
+
+void scaler_run(const scaler_t *scaler, const u16 *fb, u8 *pixels, int pitch) {
+    u32 line[160];
+    u8 *first;
+    int fbline, l;
+
+    for(fbline = 0; fbline < 144; fbline++) {
+        if(scaler->lines[fbline] == 0) {
+            continue;
+        }
+
+        first = pixels;
+        scale_line(scaler, &fb[fbline * 160], line, first);
+        pixels += pitch;
+
+        for(l = 1; l < scaler->lines[fbline]; l++, pixels += pitch) {
+            memcpy(pixels, first, scaler->w * scaler->format.bytes_per_pixel);
+        }
+    }
+}
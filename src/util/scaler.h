@@ -0,0 +1,40 @@
+#ifndef UTIL_SCALER_H
+#define UTIL_SCALER_H
+
+#include "core/defines.h"
+
+#define SCALER_MAX_FACTOR 6
+
+/*
+    Converts the 160x144 framebuffer, which holds 15 bit CGB colors, to the
+    host's pixel format and scales it into an area of any size, writing
+    each pixel once. Lines are converted a whole vector at a time (SSE2 or
+    NEON if available). Widths of 2 to SCALER_MAX_FACTOR times 160 are
+    replicated by a dedicated kernel, other widths read the source column
+    of each area column from a table. Each framebuffer line is scaled into
+    the first area line it covers, the others are copied from that one
+*/
+
+typedef struct {
+    int bytes_per_pixel; // 2 or 4
+    int rshift, gshift, bshift; // Position of each component's lowest bit
+    int rloss, gloss, bloss; // Bits each component has less than 8
+    u32 alpha; // Set in every pixel
+} scaler_format_t;
+
+typedef struct {
+    scaler_format_t format;
+    int w, h;
+    int factor; // Horizontal, 0 if the width isn't a supported multiple of 160
+    u8 *columns; // Source column of each area column
+    u16 lines[144]; // Area lines each framebuffer line covers
+} scaler_t;
+
+void scaler_init(scaler_t *scaler, int w, int h);
+void scaler_set_format(scaler_t *scaler, const scaler_format_t *format);
+void scaler_close(scaler_t *scaler);
+
+// pixels is the top left of the area, pitch in bytes
+void scaler_run(const scaler_t *scaler, const u16 *fb, u8 *pixels, int pitch);
+
+#endif
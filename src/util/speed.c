@@ -2,6 +2,7 @@
 #include "core/cpu.h"
 #include "sys/sys.h"
 #include "util/performance.h"
+#include "core/instance.h"
 
 speed_t speed;
 
@@ -17,14 +18,14 @@ void speed_begin() {
 void speed_limit() {
     int period = sys.ticks - (long)speed.last_limit_check;
 
-    speed.cc_ahead += sys.invoke_cc;
-    speed.cc_ahead -= (period * cpu.freq * speed.factor)/1000;
+    speed.cc_ahead += HW.invoke_cc;
+    speed.cc_ahead -= (period * CPU.freq * speed.factor)/1000;
 
     // Set a lower limit for cc_ahead, kinda random
-    speed.cc_ahead = max(speed.cc_ahead, -cpu.freq/10);
+    speed.cc_ahead = max(speed.cc_ahead, -CPU.freq/10);
 
     if(speed.factor < SPEED_MAX_FACTOR) {
-        int ms_ahead = speed.cc_ahead / (((long)cpu.freq/1000));
+        int ms_ahead = speed.cc_ahead / (((long)CPU.freq/1000));
         if(ms_ahead >= SPEED_DELAY_THRESHOLD) {
             sys_delay(SPEED_DELAY_THRESHOLD);
             performance.counting.slept += SPEED_DELAY_THRESHOLD;
@@ -14,10 +14,13 @@
 #include "core/moo.h"
 #include "core/mem.h"
 #include "core/maps.h"
+#include "core/obj.h"
+#include "core/render.h"
 #include "core/timers.h"
 #include "core/sound.h"
 #include "core/lcd.h"
 #include "core/defines.h"
+#include "core/instance.h"
 
 #define BYTE(val) ((u8)(val))
 
@@ -35,18 +38,17 @@
 #define RTC_EVENT_ID 11
 #define NUM_HW_EVENTS 12
 
-static hw_event_t *id2event[] = {
-    &lcd.mode_event[0], &lcd.mode_event[1], &lcd.mode_event[2], &lcd.mode_event[3],
-    &lcd.vblank_line_event, &sound_mix_event, &sound_sweep_event, &sound_envelopes_event,
-    &sound_length_counters_event, &timers_tima_event, &timers_div_event, &rtc_event
-};
+#define ID2EVENT \
+    &LCD.mode_event[0], &LCD.mode_event[1], &LCD.mode_event[2], &LCD.mode_event[3], \
+    &LCD.vblank_line_event, &SOUND_MIX_EVENT, &SOUND_SWEEP_EVENT, &SOUND_ENVELOPES_EVENT, \
+    &SOUND_LENGTH_COUNTERS_EVENT, &TIMERS_TIMA_EVENT, &TIMERS_DIV_EVENT, &RTC_EVENT
 
 #define STATE_PREFIX "mbs"
-static const u8 STATE_REVISION = 0x01;
+static const u8 STATE_REVISION = 0x02;
 
-static FILE *f;
-static u8 byte;
-static u8 loading_revision;
+static __thread FILE *f;
+static __thread u8 byte;
+static __thread u8 loading_revision;
 
 typedef struct {
     void *ptr;
@@ -63,91 +65,87 @@ typedef struct {
     V((c).on), \
     V((c).l), V((c).r), \
     V((c).freq), V((c).duty), V((c).volume), \
-    V((c).cc), V((c).cc_reset),\
+    V((c).pos), V((c).next), \
     V((c).counter.length), V((c).counter.expires)
 
 #define _env(e) V((e).sweep), V((e).tick), V((e).dir)
 
 #define NUM_VALUES (sizeof(values)/sizeof(*values))
 
-static value_t values[] = {
-    V(cpu.af), V(cpu.bc), V(cpu.de), V(cpu.hl),
-    V(SP), V(PC),
-    V(cpu.op), V(cpu.cb),
-    V(cpu.ime), V(cpu.irq), V(cpu.ie),
-    V(cpu.remainder),
-    V(cpu.freq),
-    V(cpu.freq_factor),
-    V(cpu.freq_switch),
-    V(cpu.halted),
-    V(joy.col),
-    VA(lcd.fb),
-    V(lcd.c),
-    V(lcd.stat),
-    V(lcd.scx), V(lcd.scy),
-    V(lcd.ly), V(lcd.lyc),
-    V(lcd.wx), V(lcd.wy),
-    VA(lcd.bgp.b), VA(lcd.obp.b),
-    VA(lcd.bgp.d), VA(lcd.obp.d),
-    V(lcd.bgp.s), V(lcd.bgp.i),
-    V(lcd.obp.s), V(lcd.obp.i),
-    V(lcd.hdma_source), V(lcd.hdma_dest),
-    V(lcd.hdma_length), V(lcd.hdma_inactive),
-    V(mbc.type),
-    V(mbc.has_rtc),
-    V(mbc.has_battery),
-    V(mbc1.mode),
-    V(mbc1.rombank),
-    V(mbc3.mode),
-    V(mbc5.rombank),
-    V(card.romsize),
-    V(card.sramsize),
-    VA(card.srambanks),
-    VA(ram.rambanks),
-    VA(ram.vrambanks),
-    VA(ram.hram),
-    VA(ram.oam),
-    V(ram.rambank_index),
-    VA(rtc.latched),
-    VA(rtc.ticking),
-    V(rtc.mapped),
-    V(rtc.prelatched),
-    V(sound.on),
-    V(sound.so1_volume), V(sound.so2_volume),
-    V(sound.mix_threshold),
-    V(sound.cc_reset),
-    V(sound.remainder),
-    _sqw(sqw[0]), _sqw(sqw[1]),
-    _env(env[0]), _env(env[1]), _env(env[2]),
-    V(sweep.period), V(sweep.dir), V(sweep.shift), V(sweep.tick),
-    V(wave.on),
-    V(wave.cc), V(wave.cc_reset),
-    V(wave.l), V(wave.r),
-    V(wave.freq),
-    V(wave.shift),
-    VA(wave.data),
-    V(wave.counter.length), V(wave.counter.expires),
-    V(noise.on),
-    V(noise.cc), V(noise.cc_reset),
-    V(noise.l), V(noise.r),
-    V(noise.volume),
-    V(noise.shift),
-    V(noise.width),
-    V(noise.divr),
-    V(noise.lsfr),
-    V(noise.counter.length), V(noise.counter.expires),
-    V(timers.div), V(timers.tima), V(timers.tma), V(timers.tac),
-    V(timers.div_cc), V(timers.tima_cc),
-    V(sys.ticks),
-    V(sys.invoke_cc),
-    V(framerate.skipped),
-    V(framerate.delay_threshold),
-    V(framerate.first_frame_ticks),
-    V(framerate.framecount),
-    V(speed.cc_ahead),
-    V(speed.last_limit_check),
-    V(hw.cc)
-};
+/* Addresses depend on the selected instance, so the table is built locally */
+#define VALUES \
+    V(CPU.af), V(CPU.bc), V(CPU.de), V(CPU.hl), \
+    V(SP), V(PC), \
+    V(CPU.op), V(CPU.cb), \
+    V(CPU.ime), V(CPU.irq), V(CPU.ie), \
+    V(CPU.remainder), \
+    V(CPU.freq), \
+    V(CPU.freq_factor), \
+    V(CPU.freq_switch), \
+    V(CPU.halted), \
+    V(JOY.col), \
+    V(LCD.c), \
+    V(LCD.stat), \
+    V(LCD.scx), V(LCD.scy), \
+    V(LCD.ly), V(LCD.lyc), \
+    V(LCD.wx), V(LCD.wy), \
+    VA(LCD.bgp.b), VA(LCD.obp.b), \
+    VA(LCD.bgp.d), VA(LCD.obp.d), \
+    V(LCD.bgp.s), V(LCD.bgp.i), \
+    V(LCD.obp.s), V(LCD.obp.i), \
+    V(LCD.hdma_source), V(LCD.hdma_dest), \
+    V(LCD.hdma_length), V(LCD.hdma_inactive), \
+    V(MBC.type), \
+    V(MBC.has_rtc), \
+    V(MBC.has_battery), \
+    V(MBC1.mode), \
+    V(MBC1.rombank), \
+    V(MBC3.mode), \
+    V(MBC5.rombank), \
+    V(CARD.romsize), \
+    V(CARD.sramsize), \
+    VA(CARD.srambanks), \
+    VA(RAM.rambanks), \
+    VA(RAM.vrambanks), \
+    VA(RAM.hram), \
+    VA(RAM.oam), \
+    V(RAM.rambank_index), \
+    VA(RTC.latched), \
+    VA(RTC.ticking), \
+    V(RTC.mapped), \
+    V(RTC.prelatched), \
+    V(SOUND.on), \
+    V(SOUND.so1_volume), V(SOUND.so2_volume), \
+    _sqw(SQW[0]), _sqw(SQW[1]), \
+    _env(ENV[0]), _env(ENV[1]), _env(ENV[2]), \
+    V(SWEEP.period), V(SWEEP.dir), V(SWEEP.shift), V(SWEEP.tick), \
+    V(WAVE.on), \
+    V(WAVE.pos), V(WAVE.next), \
+    V(WAVE.l), V(WAVE.r), \
+    V(WAVE.freq), \
+    V(WAVE.shift), \
+    VA(WAVE.data), \
+    V(WAVE.counter.length), V(WAVE.counter.expires), \
+    V(NOISE.on), \
+    V(NOISE.next), \
+    V(NOISE.l), V(NOISE.r), \
+    V(NOISE.volume), \
+    V(NOISE.shift), \
+    V(NOISE.width), \
+    V(NOISE.divr), \
+    V(NOISE.lsfr), \
+    V(NOISE.counter.length), V(NOISE.counter.expires), \
+    V(TIMERS.div), V(TIMERS.tima), V(TIMERS.tma), V(TIMERS.tac), \
+    V(TIMERS.div_cc), V(TIMERS.tima_cc), \
+    V(sys.ticks), \
+    V(HW.invoke_cc), \
+    V(framerate.skipped), \
+    V(framerate.delay_threshold), \
+    V(framerate.first_frame_ticks), \
+    V(framerate.framecount), \
+    V(speed.cc_ahead), \
+    V(speed.last_limit_check), \
+    V(HW.cc)
 
 static void save_prefix() {
     fprintf(f, "%s", STATE_PREFIX);
@@ -155,6 +153,7 @@ static void save_prefix() {
 }
 
 static void save_values() {
+    value_t values[] = {VALUES};
     int v;
     for(v = 0; v < NUM_VALUES; v++) {
         fwrite(values[v].ptr, 1, values[v].size, f);
@@ -162,41 +161,42 @@ static void save_values() {
 }
 
 static u8 hw_event_to_id(hw_event_t *event) {
-    if(event == &lcd.mode_event[0]) return LCD_MODE_0_EVENT_ID;
-    if(event == &lcd.mode_event[1]) return LCD_MODE_1_EVENT_ID;
-    if(event == &lcd.mode_event[2]) return LCD_MODE_2_EVENT_ID;
-    if(event == &lcd.mode_event[3]) return LCD_MODE_3_EVENT_ID;
-    if(event == &lcd.vblank_line_event) return LCD_VBLANK_LINE_EVENT_ID;
-    if(event == &sound_mix_event) return SOUND_MIX_EVENT_ID;
-    if(event == &sound_sweep_event) return SOUND_SWEEP_EVENT_ID;
-    if(event == &sound_envelopes_event) return SOUND_ENVELOPES_EVENT_ID;
-    if(event == &sound_length_counters_event) return SOUND_LENGTH_COUNTERS_EVENT_ID;
-    if(event == &timers_tima_event) return TIMERS_TIMA_EVENT_ID;
-    if(event == &timers_div_event) return TIMER_DIV_EVENT_ID;
-    if(event == &rtc_event) return RTC_EVENT_ID;
+    if(event == &LCD.mode_event[0]) return LCD_MODE_0_EVENT_ID;
+    if(event == &LCD.mode_event[1]) return LCD_MODE_1_EVENT_ID;
+    if(event == &LCD.mode_event[2]) return LCD_MODE_2_EVENT_ID;
+    if(event == &LCD.mode_event[3]) return LCD_MODE_3_EVENT_ID;
+    if(event == &LCD.vblank_line_event) return LCD_VBLANK_LINE_EVENT_ID;
+    if(event == &SOUND_MIX_EVENT) return SOUND_MIX_EVENT_ID;
+    if(event == &SOUND_SWEEP_EVENT) return SOUND_SWEEP_EVENT_ID;
+    if(event == &SOUND_ENVELOPES_EVENT) return SOUND_ENVELOPES_EVENT_ID;
+    if(event == &SOUND_LENGTH_COUNTERS_EVENT) return SOUND_LENGTH_COUNTERS_EVENT_ID;
+    if(event == &TIMERS_TIMA_EVENT) return TIMERS_TIMA_EVENT_ID;
+    if(event == &TIMERS_DIV_EVENT) return TIMER_DIV_EVENT_ID;
+    if(event == &RTC_EVENT) return RTC_EVENT_ID;
     assert(0);
 }
 
-static void save_hw_queue(hw_event_t *q) {
-    hw_event_t *event;
-    for(event = q; event != NULL; event = event->next) {
-        byte = hw_event_to_id(event); S(byte);
-        S(event->mcs);
+static void save_hw() {
+    int e;
+
+    S(HW.cc);
+
+    for(e = 0; e < HW.queue_length; e++) {
+        byte = hw_event_to_id(HW.queue[e]); S(byte);
+        S(HW.queue[e]->mcs);
     }
     byte = 0xFF; S(byte);
-}
 
-static void save_hw() {
-    S(hw.cc);
-    save_hw_queue(hw.queue);
-    save_hw_queue(hw.sched);
+    // Formerly the list of events not yet sorted in, kept for compatibility
+    byte = 0xFF; S(byte);
 }
 
 
 static void save_misc() {
-    byte = (u8(*)[0x4000])mbc.rombank - card.rombanks; S(byte);
-    byte = (u8(*)[0x2000])mbc.srambank - card.srambanks; S(byte);
-    byte = (u8(*)[0x1000])ram.rambank - ram.rambanks; S(byte);
+    fwrite(LCD.clean_fb, sizeof(LCD.fb[0]), 1, f);
+    byte = (u8(*)[0x4000])MBC.rombank - CARD.rombanks; S(byte);
+    byte = (u8(*)[0x2000])MBC.srambank - CARD.srambanks; S(byte);
+    byte = (u8(*)[0x1000])RAM.rambank - RAM.rambanks; S(byte);
     save_hw();
 }
 
@@ -228,11 +228,16 @@ static int load_prefix() {
         moo_errorf("Savestate too small");
         return 1;
     }
+    if(loading_revision != STATE_REVISION) {
+        moo_errorf("Savestate is from an incompatible version (revision %i)", loading_revision);
+        return 1;
+    }
 
     return 0;
 }
 
 static int load_values() {
+    value_t values[] = {VALUES};
     int v;
     for(v = 0; v < NUM_VALUES; v++) {
         size_t read = fread(values[v].ptr, 1, values[v].size, f);
@@ -245,6 +250,8 @@ static int load_values() {
 }
 
 static hw_event_t *hw_id_to_event(u8 id) {
+    hw_event_t *id2event[] = {ID2EVENT};
+
     if(id < NUM_HW_EVENTS) {
         return id2event[id];
     }
@@ -275,7 +282,7 @@ static int load_hw_queue() {
         event->dbg_queued = 0;
 #endif
         R(mcs);
-        hw_schedule(event, mcs - hw.cc);
+        hw_schedule(event, mcs - HW.cc);
     }
 
     return 0;
@@ -285,7 +292,7 @@ static int load_hw() {
     int error = 0;
 
     hw_reset();
-    R(hw.cc);
+    R(HW.cc);
     error |= load_hw_queue();
     error |= load_hw_queue();
 
@@ -295,15 +302,35 @@ static int load_hw() {
 static int load_misc() {
     int error = 0;
 
-    joy.state = 0xFF;
+    JOY.state = 0xFF;
 
-    error |= fread(&byte, 1, 1, f) != 1; mbc.rombank = card.rombanks[byte];
-    error |= fread(&byte, 1, 1, f) != 1; mbc.srambank = card.srambanks[byte & 0x03];
-    error |= fread(&byte, 1, 1, f) != 1; ram.rambank = ram.rambanks[byte & 0x07];
+    /*
+        Only the latest complete frame is saved, it becomes the ready one.
+        It also fills the working frame, whose lines above LY won't be
+        drawn before the next frame
+    */
+#ifdef RENDER_THREAD
+    if(RENDERER != NULL) {
+        render_sync();
+    }
+#endif
+    lcd_reset_fb();
+    error |= fread(LCD.clean_fb, sizeof(LCD.fb[0]), 1, f) != 1;
+    memcpy(LCD.working_fb, LCD.clean_fb, sizeof(LCD.fb[0]));
+
+    error |= fread(&byte, 1, 1, f) != 1; MBC.rombank = mbc_rombank(byte);
+    error |= fread(&byte, 1, 1, f) != 1; MBC.srambank = CARD.srambanks[byte & 0x03];
+    error |= fread(&byte, 1, 1, f) != 1; RAM.rambank = RAM.rambanks[byte & 0x07];
     error |= load_hw();
 
+    mem_update_pages();
+
     maps_dirty();
+    maps_rebuild_refs();
+    obj_dirty();
     lcd_rebuild_palette_maps();
+    render_resync();
+    sound_resync();
 
     return error;
 }
@@ -326,10 +353,10 @@ int state_load(const char *filename) {
     }
     fclose(f);
 
-    if(~moo.state & MOO_ERROR_BIT) {
+    if(~MOO.state & MOO_ERROR_BIT) {
         moo_continue();
     }
 
-    return ~moo.state & MOO_ERROR_BIT;
+    return ~MOO.state & MOO_ERROR_BIT;
 }
 